@@ -0,0 +1,207 @@
+/* acpi.c - ACPI table discovery for the MADT.
+ * vim:ts=4 noexpandtab
+ */
+#include "acpi.h"
+#include "lib.h"
+#include "process_control.h"
+
+/*
+ * early_map(uint32_t phys)
+ *   DESCRIPTION: Maps physical memory the kernel does not otherwise map, such
+ *                as BIOS memory and ACPI tables, through a window of two 4MB
+ *                pages. Only one mapping exists at a time.
+ *   INPUTS: uint32_t phys - physical address.
+ *   OUTPUTS: none
+ *   RETURN VALUE: Virtual address of phys. At least 4MB from there on are
+ *                 mapped.
+ *   SIDE EFFECTS: Replaces the previous window mapping. Boot time only: the
+ *                 window is in the kernel's page directory alone.
+ */
+void * early_map(uint32_t phys)
+{
+    uint32_t base = phys & ~LARGE_PAGE_MASK;
+
+    process_pages[EARLY_MAP_IDX] = base | LARGE_PAGE | READWRITE_MASK | PRESENT_MASK;
+    process_pages[EARLY_MAP_IDX + 1] = (base + M_4) | LARGE_PAGE | READWRITE_MASK | PRESENT_MASK;
+    invlpg(EARLY_MAP_BASE);
+    invlpg(EARLY_MAP_BASE + M_4);
+    return (void *)(EARLY_MAP_BASE + (phys & LARGE_PAGE_MASK));
+}
+
+/*
+ * early_unmap()
+ *   DESCRIPTION: Removes the early_map window.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Pointers from early_map are no longer valid.
+ */
+void early_unmap()
+{
+    process_pages[EARLY_MAP_IDX] = READWRITE_MASK;
+    process_pages[EARLY_MAP_IDX + 1] = READWRITE_MASK;
+    invlpg(EARLY_MAP_BASE);
+    invlpg(EARLY_MAP_BASE + M_4);
+}
+
+/*
+ * acpi_checksum(const void * table, uint32_t length)
+ *   DESCRIPTION: Sums the bytes of an ACPI structure.
+ *   INPUTS: const void * table - the structure.
+ *           uint32_t length - its length in bytes.
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the bytes sum to zero, 0 if not.
+ *   SIDE EFFECTS: none
+ */
+static int acpi_checksum(const void * table, uint32_t length)
+{
+    const uint8_t * bytes = table;
+    uint8_t sum = 0;
+    uint32_t i;
+
+    for (i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+/*
+ * acpi_find_rsdp(uint8_t * low, uint32_t start, uint32_t end)
+ *   DESCRIPTION: Scans a range of low memory for the RSDP signature.
+ *   INPUTS: uint8_t * low - early_map of physical address 0.
+ *           uint32_t start - physical address to start at.
+ *           uint32_t end - physical address to stop at.
+ *   OUTPUTS: none
+ *   RETURN VALUE: The RSDT's physical address, or 0 if not found.
+ *   SIDE EFFECTS: none
+ */
+static uint32_t acpi_find_rsdp(uint8_t * low, uint32_t start, uint32_t end)
+{
+    acpi_rsdp_t * rsdp;
+
+    for (; start + sizeof(acpi_rsdp_t) <= end; start += RSDP_ALIGN) {
+        rsdp = (acpi_rsdp_t *)(low + start);
+        if (strncmp((int8_t *)rsdp->signature, (int8_t *)"RSD PTR ", 8) == 0 &&
+            acpi_checksum(rsdp, sizeof(acpi_rsdp_t))) {
+            return rsdp->rsdt;
+        }
+    }
+    return 0;
+}
+
+/*
+ * acpi_parse_madt(acpi_madt_t * madt)
+ *   DESCRIPTION: Records the local APIC address, the usable processors, the
+ *                first IOAPIC and the ISA IRQs that are routed differently
+ *                from their identity mapping.
+ *   INPUTS: acpi_madt_t * madt - the mapped MADT.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Fills in lapic_phys, cpu_apic_ids, num_cpus, ioapic_phys,
+ *                 ioapic_gsi_base, isa_irq_gsi and isa_irq_flags.
+ */
+static void acpi_parse_madt(acpi_madt_t * madt)
+{
+    uint8_t * entry = (uint8_t *)(madt + 1);
+    uint8_t * end = (uint8_t *)madt + madt->header.length;
+    madt_lapic_t * lapic;
+    madt_ioapic_t * ioapic;
+    madt_override_t * override;
+
+    lapic_phys = madt->lapic;
+    num_cpus = 0;
+    while (entry + 2 <= end && entry[1] >= 2) {
+        if (entry[0] == MADT_LAPIC && num_cpus < MAX_CPUS) {
+            lapic = (madt_lapic_t *)entry;
+            if (lapic->flags & MADT_CPU_ENABLED) {
+                cpu_apic_ids[num_cpus++] = lapic->apic_id;
+            }
+        } else if (entry[0] == MADT_IOAPIC && ioapic_phys == 0) {
+            // The ISA IRQs are on the first IOAPIC on every PC we run on.
+            ioapic = (madt_ioapic_t *)entry;
+            ioapic_phys = ioapic->address;
+            ioapic_gsi_base = ioapic->gsi_base;
+        } else if (entry[0] == MADT_OVERRIDE) {
+            override = (madt_override_t *)entry;
+            if (override->bus == 0 && override->source < ISA_IRQS) {
+                isa_irq_gsi[override->source] = override->gsi;
+                isa_irq_flags[override->source] = override->flags;
+            }
+        }
+        entry += entry[1];
+    }
+    if (num_cpus == 0) {
+        num_cpus = 1;
+    }
+}
+
+/*
+ * acpi_init()
+ *   DESCRIPTION: Finds the MADT through the RSDP and RSDT and reads the
+ *                processors and local APIC address out of it.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: SUCCESS if a MADT was found, FAILURE if not. num_cpus is
+ *                 1 either way when there is no MADT.
+ *   SIDE EFFECTS: Uses the early_map window, and leaves it unmapped.
+ */
+int acpi_init()
+{
+    uint32_t tables[RSDT_MAX_ENTRIES];
+    acpi_header_t * header;
+    uint32_t rsdt;
+    uint32_t ebda;
+    uint32_t count;
+    uint32_t i;
+    uint8_t * low;
+    int found = FAILURE;
+
+    lapic_phys = 0;
+    num_cpus = 1;
+    ioapic_phys = 0;
+    ioapic_gsi_base = 0;
+    for (i = 0; i < ISA_IRQS; i++) {
+        isa_irq_gsi[i] = i;
+        isa_irq_flags[i] = 0;
+    }
+
+    low = early_map(0);
+    ebda = (uint32_t)(*(uint16_t *)(low + EBDA_SEGMENT_PTR)) << 4;
+    rsdt = 0;
+    if (ebda != 0 && ebda < BIOS_ROM_END) {
+        rsdt = acpi_find_rsdp(low, ebda, ebda + EBDA_SEARCH_BYTES);
+    }
+    if (rsdt == 0) {
+        rsdt = acpi_find_rsdp(low, BIOS_ROM_START, BIOS_ROM_END);
+    }
+    if (rsdt == 0) {
+        early_unmap();
+        return FAILURE;
+    }
+
+    // Copy the table pointers out, since mapping each table moves the window.
+    header = early_map(rsdt);
+    if (strncmp((int8_t *)header->signature, (int8_t *)"RSDT", 4) != 0 ||
+        !acpi_checksum(header, header->length)) {
+        early_unmap();
+        return FAILURE;
+    }
+    count = (header->length - sizeof(acpi_header_t)) / sizeof(uint32_t);
+    if (count > RSDT_MAX_ENTRIES) {
+        count = RSDT_MAX_ENTRIES;
+    }
+    memcpy(tables, header + 1, count * sizeof(uint32_t));
+
+    for (i = 0; i < count; i++) {
+        header = early_map(tables[i]);
+        if (strncmp((int8_t *)header->signature, (int8_t *)"APIC", 4) == 0 &&
+            acpi_checksum(header, header->length)) {
+            acpi_parse_madt((acpi_madt_t *)header);
+            found = SUCCESS;
+            break;
+        }
+    }
+
+    early_unmap();
+    return found;
+}
@@ -0,0 +1,104 @@
+/* acpi.h - ACPI table discovery for the MADT.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#include "types.h"
+#include "x86_desc.h"
+
+#define EARLY_MAP_IDX       0x3F0       // Directory entry of the boot-time physical window.
+#define EARLY_MAP_BASE      0xFC000000  // Virtual address of the window, two 4MB pages.
+#define LARGE_PAGE_MASK     0x003FFFFF  // Offset within a 4MB page.
+#define LARGE_PAGE          0x00000080  // Directory entry maps a 4MB page.
+#define EBDA_SEGMENT_PTR    0x40E       // BIOS data area word holding the EBDA segment.
+#define EBDA_SEARCH_BYTES   0x400       // RSDP may be in the first 1kB of the EBDA.
+#define BIOS_ROM_START      0xE0000     // RSDP may be anywhere in the BIOS ROM area.
+#define BIOS_ROM_END        0x100000
+#define RSDP_ALIGN          16
+#define RSDT_MAX_ENTRIES    32          // Tables looked at in the RSDT.
+#define MADT_LAPIC          0           // MADT entry for a processor's local APIC.
+#define MADT_IOAPIC         1           // MADT entry for an IOAPIC.
+#define MADT_OVERRIDE       2           // MADT entry remapping an ISA IRQ.
+#define MADT_CPU_ENABLED    0x1         // Processor can be started.
+#define ISA_IRQS            16          // Legacy IRQs an override can remap.
+#define MPS_POLARITY_MASK   0x3         // Override flags: polarity field.
+#define MPS_ACTIVE_LOW      0x3
+#define MPS_TRIGGER_MASK    0xC         // Override flags: trigger mode field.
+#define MPS_LEVEL           0xC
+
+// ACPI System Description Table Header, at the start of every table.
+typedef struct acpi_header
+{
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+// Root System Description Pointer, found by scanning BIOS memory.
+typedef struct acpi_rsdp
+{
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt;
+} __attribute__((packed)) acpi_rsdp_t;
+
+// Multiple APIC Description Table. Variable length entries follow it.
+typedef struct acpi_madt
+{
+    acpi_header_t header;
+    uint32_t lapic;
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_t;
+
+// MADT Processor Local APIC Entry.
+typedef struct madt_lapic
+{
+    uint8_t type;
+    uint8_t length;
+    uint8_t acpi_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed)) madt_lapic_t;
+
+// MADT IOAPIC Entry.
+typedef struct madt_ioapic
+{
+    uint8_t type;
+    uint8_t length;
+    uint8_t ioapic_id;
+    uint8_t reserved;
+    uint32_t address;
+    uint32_t gsi_base;          // First global interrupt on its pins.
+} __attribute__((packed)) madt_ioapic_t;
+
+// MADT Interrupt Source Override Entry. An ISA IRQ wired to a different
+// global interrupt, or with other than edge triggered, active high signalling.
+typedef struct madt_override
+{
+    uint8_t type;
+    uint8_t length;
+    uint8_t bus;
+    uint8_t source;             // ISA IRQ.
+    uint32_t gsi;
+    uint16_t flags;             // MPS_* polarity and trigger mode.
+} __attribute__((packed)) madt_override_t;
+
+uint32_t lapic_phys;                // Physical address of the local APICs, 0 if no MADT.
+uint8_t cpu_apic_ids[MAX_CPUS];     // APIC IDs of the usable processors, in MADT order.
+int num_cpus;                       // Usable processors, at least 1.
+uint32_t ioapic_phys;               // Physical address of the first IOAPIC, 0 if none.
+uint32_t ioapic_gsi_base;           // Global interrupt on its pin 0.
+uint32_t isa_irq_gsi[ISA_IRQS];     // Global interrupt each ISA IRQ arrives on.
+uint16_t isa_irq_flags[ISA_IRQS];   // Its MPS_* flags, 0 for the ISA default.
+
+extern void * early_map(uint32_t phys);
+extern void early_unmap();
+extern int acpi_init();
@@ -0,0 +1,322 @@
+/* apic.c - Local APIC and IOAPIC access.
+ * vim:ts=4 noexpandtab
+ */
+#include "apic.h"
+#include "acpi.h"
+#include "lib.h"
+#include "i8259.h"
+#include "clocksource.h"
+#include "process_control.h"
+
+static uint32_t ioapic_pins;    // Redirection entries of the IOAPIC.
+
+/*
+ * apic_map_page(uint32_t phys)
+ *   DESCRIPTION: Maps the 4MB page holding APIC registers at its physical
+ *                address, uncached and global, in the kernel's page
+ *                directory.
+ *   INPUTS: uint32_t phys - physical address of the registers.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void apic_map_page(uint32_t phys)
+{
+    process_pages[phys >> 22] = (phys & ~LARGE_PAGE_MASK) | LARGE_PAGE |
+        PAGE_CACHE_DISABLE | PAGE_WRITE_THROUGH | GLOBAL_MASK | READWRITE_MASK | PRESENT_MASK;
+    invlpg(phys);
+}
+
+/*
+ * apic_map()
+ *   DESCRIPTION: Maps the local APICs and the IOAPIC at their physical
+ *                addresses. They usually share a 4MB page. Does nothing
+ *                without a MADT.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Sets lapic and ioapic. Must run after paging_init and
+ *                 acpi_init.
+ */
+void apic_map()
+{
+    lapic = NULL;
+    ioapic = NULL;
+    if (lapic_phys == 0) {
+        return;
+    }
+
+    apic_map_page(lapic_phys);
+    lapic = (volatile uint32_t *)lapic_phys;
+    if (ioapic_phys != 0) {
+        apic_map_page(ioapic_phys);
+        ioapic = (volatile uint32_t *)ioapic_phys;
+    }
+}
+
+/*
+ * apic_map_directory(uint32_t * directory)
+ *   DESCRIPTION: Copies the APIC mappings into a process's page directory,
+ *                so the kernel can reach them from any process.
+ *   INPUTS: uint32_t * directory - the page directory.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void apic_map_directory(uint32_t * directory)
+{
+    if (lapic != NULL) {
+        directory[lapic_phys >> 22] = process_pages[lapic_phys >> 22];
+    }
+    if (ioapic != NULL) {
+        directory[ioapic_phys >> 22] = process_pages[ioapic_phys >> 22];
+    }
+}
+
+/*
+ * ioapic_read(uint32_t reg)
+ *   DESCRIPTION: Reads an IOAPIC register through its select and window.
+ *   INPUTS: uint32_t reg - register index.
+ *   OUTPUTS: none
+ *   RETURN VALUE: The register's value.
+ *   SIDE EFFECTS: none
+ */
+static uint32_t ioapic_read(uint32_t reg)
+{
+    ioapic[IOAPIC_REGSEL / sizeof(uint32_t)] = reg;
+    return ioapic[IOAPIC_WIN / sizeof(uint32_t)];
+}
+
+/*
+ * ioapic_write(uint32_t reg, uint32_t value)
+ *   DESCRIPTION: Writes an IOAPIC register through its select and window.
+ *   INPUTS: uint32_t reg - register index.
+ *           uint32_t value - value to write.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Depends on the register.
+ */
+static void ioapic_write(uint32_t reg, uint32_t value)
+{
+    ioapic[IOAPIC_REGSEL / sizeof(uint32_t)] = reg;
+    ioapic[IOAPIC_WIN / sizeof(uint32_t)] = value;
+}
+
+/*
+ * ioapic_pin(uint32_t irq)
+ *   DESCRIPTION: Finds the IOAPIC pin an ISA IRQ arrives on, following the
+ *                MADT's interrupt source overrides.
+ *   INPUTS: uint32_t irq - ISA IRQ.
+ *   OUTPUTS: none
+ *   RETURN VALUE: The pin, or ioapic_pins if the IRQ is not on this IOAPIC.
+ *   SIDE EFFECTS: none
+ */
+static uint32_t ioapic_pin(uint32_t irq)
+{
+    uint32_t pin;
+
+    if (irq >= ISA_IRQS || isa_irq_gsi[irq] < ioapic_gsi_base) {
+        return ioapic_pins;
+    }
+    pin = isa_irq_gsi[irq] - ioapic_gsi_base;
+    return (pin < ioapic_pins) ? pin : ioapic_pins;
+}
+
+/*
+ * ioapic_route(uint32_t irq)
+ *   DESCRIPTION: Points an ISA IRQ's redirection entry at the boot CPU, on
+ *                the vector the 8259s would have given it, with the
+ *                polarity and trigger mode from the MADT. The entry is left
+ *                masked.
+ *   INPUTS: uint32_t irq - ISA IRQ.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void ioapic_route(uint32_t irq)
+{
+    uint32_t pin = ioapic_pin(irq);
+    uint32_t entry = IOAPIC_MASKED | (IRQ_VECTOR_BASE + irq);
+
+    if (pin == ioapic_pins) {
+        return;
+    }
+    if ((isa_irq_flags[irq] & MPS_POLARITY_MASK) == MPS_ACTIVE_LOW) {
+        entry |= IOAPIC_ACTIVE_LOW;
+    }
+    if ((isa_irq_flags[irq] & MPS_TRIGGER_MASK) == MPS_LEVEL) {
+        entry |= IOAPIC_LEVEL;
+    }
+    ioapic_write(IOAPIC_REDTBL + 2 * pin + 1, lapic_id() << LAPIC_ID_SHIFT);
+    ioapic_write(IOAPIC_REDTBL + 2 * pin, entry);
+}
+
+/*
+ * ioapic_unmask(uint32_t irq)
+ *   DESCRIPTION: Lets an ISA IRQ through the IOAPIC.
+ *   INPUTS: uint32_t irq - ISA IRQ.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void ioapic_unmask(uint32_t irq)
+{
+    uint32_t pin = ioapic_pin(irq);
+
+    if (pin != ioapic_pins) {
+        ioapic_write(IOAPIC_REDTBL + 2 * pin,
+            ioapic_read(IOAPIC_REDTBL + 2 * pin) & ~IOAPIC_MASKED);
+    }
+}
+
+/*
+ * ioapic_mask(uint32_t irq)
+ *   DESCRIPTION: Stops an ISA IRQ at the IOAPIC.
+ *   INPUTS: uint32_t irq - ISA IRQ.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void ioapic_mask(uint32_t irq)
+{
+    uint32_t pin = ioapic_pin(irq);
+
+    if (pin != ioapic_pins) {
+        ioapic_write(IOAPIC_REDTBL + 2 * pin,
+            ioapic_read(IOAPIC_REDTBL + 2 * pin) | IOAPIC_MASKED);
+    }
+}
+
+/*
+ * apic_irq_init()
+ *   DESCRIPTION: Moves interrupt delivery from the 8259s and the PIT to the
+ *                IOAPIC and the boot CPU's local APIC timer. The ISA IRQs
+ *                keep their vectors, and the lines already enabled on the
+ *                8259s are enabled on the IOAPIC instead. The local APIC
+ *                timer is measured over one timer tick of the TSC, and runs
+ *                one-shot on the PIT's vector from then on. Stays on the
+ *                8259s without an IOAPIC, or with the pic=1 boot option.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Sets apic_irqs, timer_divisor and timer_max_count. Masks
+ *                 both 8259s. Must run after smp_init and PIT_init, with
+ *                 interrupts off.
+ */
+void apic_irq_init()
+{
+    uint64_t start;
+    uint32_t count;
+    uint32_t irq;
+    uint32_t pin;
+    uint8_t master;
+    uint8_t slave;
+
+    apic_irqs = 0;
+    if (lapic == NULL || ioapic == NULL || pic_option) {
+        return;
+    }
+
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, SVR_ENABLE | SPURIOUS_VECTOR);
+
+    // Count the local APIC timer down across one tick's worth of TSC cycles.
+    lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | IRQ_VECTOR_BASE);
+    lapic_timer_arm(LAPIC_MAX_COUNT);
+    start = rdtsc64();
+    while (rdtsc64() - start < tsc_per_tick) {
+        asm volatile ("pause");
+    }
+    count = LAPIC_MAX_COUNT - lapic_read(LAPIC_TIMER_CURRENT);
+    lapic_timer_arm(0);
+    if (count == 0) {
+        return;
+    }
+
+    ioapic_pins = ((ioapic_read(IOAPIC_VER) >> IOAPIC_MAX_PIN_SHIFT) & 0xFF) + 1;
+    for (pin = 0; pin < ioapic_pins; pin++) {
+        ioapic_write(IOAPIC_REDTBL + 2 * pin, IOAPIC_MASKED);
+    }
+    for (irq = 0; irq < ISA_IRQS; irq++) {
+        ioapic_route(irq);
+    }
+
+    // IRQ0 is the PIT, which the local APIC timer replaces, and IRQ2 is
+    // only the slave's cascade.
+    master = inb(MASTER_8259_PORT + 1);
+    slave = inb(SLAVE_8259_PORT + 1);
+    outb(0xFF, MASTER_8259_PORT + 1);
+    outb(0xFF, SLAVE_8259_PORT + 1);
+    for (irq = 1; irq < ISA_IRQS; irq++) {
+        if (irq == 2) {
+            continue;
+        }
+        if (!(((irq < 8) ? master >> irq : slave >> (irq - 8)) & 1)) {
+            ioapic_unmask(irq);
+        }
+    }
+
+    timer_divisor = count;
+    timer_max_count = LAPIC_MAX_COUNT;
+    apic_irqs = 1;
+    lapic_write(LAPIC_LVT_TIMER, IRQ_VECTOR_BASE);
+    lapic_timer_arm(timer_divisor);
+}
+
+/*
+ * lapic_timer_init()
+ *   DESCRIPTION: Sets up an AP's local APIC the way apic_irq_init left the
+ *                boot CPU's: every vector let in, and the timer one-shot on
+ *                the PIT's vector at the same divider. The count measured
+ *                on the boot CPU holds for every CPU, as their timers all
+ *                run off the bus clock.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Leaves the timer stopped until it is armed.
+ */
+void lapic_timer_init()
+{
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, SVR_ENABLE | SPURIOUS_VECTOR);
+    lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, IRQ_VECTOR_BASE);
+}
+
+/*
+ * lapic_id()
+ *   DESCRIPTION: Reads the APIC ID of the CPU running this.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: The APIC ID.
+ *   SIDE EFFECTS: none
+ */
+uint32_t lapic_id()
+{
+    return lapic_read(LAPIC_ID) >> LAPIC_ID_SHIFT;
+}
+
+/*
+ * lapic_send_ipi(uint32_t apic_id, uint32_t command)
+ *   DESCRIPTION: Sends an interprocessor interrupt and waits for the local
+ *                APIC to accept it.
+ *   INPUTS: uint32_t apic_id - destination CPU.
+ *           uint32_t command - low word of the interrupt command register.
+ *   OUTPUTS: none
+ *   RETURN VALUE: SUCCESS, or FAILURE if it was not accepted in time.
+ *   SIDE EFFECTS: none
+ */
+int lapic_send_ipi(uint32_t apic_id, uint32_t command)
+{
+    int i;
+
+    lapic_write(LAPIC_ICR_HIGH, apic_id << LAPIC_ID_SHIFT);
+    lapic_write(LAPIC_ICR_LOW, command);
+    for (i = 0; i < APIC_IPI_TIMEOUT; i++) {
+        if (!(lapic_read(LAPIC_ICR_LOW) & ICR_PENDING)) {
+            return SUCCESS;
+        }
+    }
+    return FAILURE;
+}
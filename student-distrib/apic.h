@@ -0,0 +1,113 @@
+/* apic.h - Local APIC and IOAPIC access.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#include "types.h"
+
+#define LAPIC_ID                0x020       // Local APIC ID register, ID in the top byte.
+#define LAPIC_TPR               0x080       // Task priority, 0 lets every vector in.
+#define LAPIC_EOI               0x0B0       // End of interrupt, write 0.
+#define LAPIC_SVR               0x0F0       // Spurious vector and APIC software enable.
+#define LAPIC_LVT_TIMER         0x320       // Timer vector, mode and mask.
+#define LAPIC_TIMER_INIT        0x380       // Timer initial count, writing starts it.
+#define LAPIC_TIMER_CURRENT     0x390       // Timer current count.
+#define LAPIC_TIMER_DIVIDE      0x3E0       // Timer input clock divider.
+#define LAPIC_ICR_LOW           0x300       // Interrupt command register, writing sends the IPI.
+#define LAPIC_ICR_HIGH          0x310       // Destination APIC ID in the top byte.
+#define LAPIC_ID_SHIFT          24
+#define ICR_INIT                0x00000500  // INIT IPI.
+#define ICR_STARTUP             0x00000600  // Startup IPI, vector is the start page.
+#define ICR_ASSERT              0x00004000  // Level assert.
+#define ICR_PENDING             0x00001000  // IPI not yet accepted.
+#define PAGE_WRITE_THROUGH      0x00000008
+#define PAGE_CACHE_DISABLE      0x00000010
+#define APIC_IPI_TIMEOUT        100000      // Polls to wait for an IPI to be accepted.
+#define SVR_ENABLE              0x00000100  // APIC software enable.
+#define SPURIOUS_VECTOR         0xFF        // Vector of spurious interrupts, never EOIed.
+#define LVT_MASKED              0x00010000  // LVT entry masked, timer one-shot mode.
+#define TIMER_DIVIDE_16         0x3         // Timer counts bus clock / 16.
+#define LAPIC_MAX_COUNT         0x7FFFFFFF  // Largest one-shot count used, well clear of 32-bit overflow.
+#define IRQ_VECTOR_BASE         0x20        // Vector of IRQ0, as the 8259s are set up.
+
+#define IOAPIC_REGSEL           0x00        // IOAPIC register select.
+#define IOAPIC_WIN              0x10        // IOAPIC data window.
+#define IOAPIC_VER              0x01        // Version register, last pin in bits 16-23.
+#define IOAPIC_REDTBL           0x10        // First redirection entry, two registers each.
+#define IOAPIC_MAX_PIN_SHIFT    16
+#define IOAPIC_ACTIVE_LOW       0x00002000  // Redirection entry: pin is active low.
+#define IOAPIC_LEVEL            0x00008000  // Redirection entry: pin is level triggered.
+#define IOAPIC_MASKED           0x00010000  // Redirection entry: pin is masked.
+
+// Local APIC registers, mapped uncached at their physical address. NULL
+// when there is no MADT.
+volatile uint32_t * lapic;
+
+// First IOAPIC's registers, mapped like lapic. NULL without one.
+volatile uint32_t * ioapic;
+
+int apic_irqs;          // Set when IRQs go through the IOAPIC and the local APIC times ticks.
+uint32_t pic_option;    // pic=1 boot option, keeps the 8259s and the PIT.
+
+/*
+ * lapic_read(uint32_t reg)
+ *   DESCRIPTION: Reads a local APIC register of this CPU.
+ *   INPUTS: uint32_t reg - register offset.
+ *   OUTPUTS: none
+ *   RETURN VALUE: The register's value.
+ *   SIDE EFFECTS: none
+ */
+static inline uint32_t lapic_read(uint32_t reg)
+{
+    return lapic[reg / sizeof(uint32_t)];
+}
+
+/*
+ * lapic_write(uint32_t reg, uint32_t value)
+ *   DESCRIPTION: Writes a local APIC register of this CPU.
+ *   INPUTS: uint32_t reg - register offset.
+ *           uint32_t value - value to write.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Depends on the register.
+ */
+static inline void lapic_write(uint32_t reg, uint32_t value)
+{
+    lapic[reg / sizeof(uint32_t)] = value;
+}
+
+/*
+ * lapic_eoi()
+ *   DESCRIPTION: Ends the interrupt in service. A single register write;
+ *                with nothing in service the local APIC ignores it.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Lets lower priority interrupts in.
+ */
+static inline void lapic_eoi()
+{
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/*
+ * lapic_timer_arm(uint32_t count)
+ *   DESCRIPTION: Starts the local APIC timer on a one-shot count.
+ *   INPUTS: uint32_t count - timer counts until the interrupt.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Replaces any count in progress.
+ */
+static inline void lapic_timer_arm(uint32_t count)
+{
+    lapic_write(LAPIC_TIMER_INIT, count);
+}
+
+extern void apic_map();
+extern void apic_map_directory(uint32_t * directory);
+extern uint32_t lapic_id();
+extern int lapic_send_ipi(uint32_t apic_id, uint32_t command);
+extern void apic_irq_init();
+extern void lapic_timer_init();
+extern void ioapic_unmask(uint32_t irq);
+extern void ioapic_mask(uint32_t irq);
@@ -0,0 +1,2 @@
+/* apic_wrapper.h: header for the apic_wrapper.S*/
+extern void spurious_wrapper();
@@ -0,0 +1,283 @@
+/* clocksource.c - TSC timebase calibrated against the PIT.
+ * vim:ts=4 noexpandtab
+ */
+#include "clocksource.h"
+#include "interrupts.h"
+#include "lib.h"
+#include "vdso.h"
+
+// ns = (cycles * clock_mult) >> clock_shift, for cycles below 2^32.
+static uint32_t clock_mult;
+static uint32_t clock_shift;
+// TSC and time of the clock's base, moved up as the clock runs.
+static uint64_t clock_base_tsc;
+static uint64_t clock_base_ns;
+// TSC of the last whole timer tick counted by clock_take_ticks.
+static uint64_t tick_mark_tsc;
+
+/*
+ * div64_32(uint64_t dividend, uint32_t divisor)
+ *   DESCRIPTION: Divides a 64-bit number by a 32-bit one with a single divl,
+ *                since there is no libgcc for 64-bit division.
+ *   INPUTS: uint64_t dividend - number to divide.
+ *           uint32_t divisor - number to divide by.
+ *   OUTPUTS: none
+ *   RETURN VALUE: The quotient. The caller makes sure it fits in 32 bits.
+ *   SIDE EFFECTS: none
+ */
+static uint32_t div64_32(uint64_t dividend, uint32_t divisor)
+{
+    uint32_t quotient;
+    uint32_t remainder;
+    asm volatile ("divl %4"
+            : "=a"(quotient), "=d"(remainder)
+            : "a"((uint32_t)dividend), "d"((uint32_t)(dividend >> 32)), "rm"(divisor)
+    );
+    return quotient;
+}
+
+/*
+ * pit_read_count()
+ *   DESCRIPTION: Latches and reads the current count of PIT channel 0.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: The count.
+ *   SIDE EFFECTS: none
+ */
+static uint16_t pit_read_count()
+{
+    uint16_t count;
+    outb(PIT_LATCH_CH0, COMMAND_REGISTER);
+    count = inb(CHANNEL_0_DATA_REGISTER);
+    count |= inb(CHANNEL_0_DATA_REGISTER) << 8;
+    return count;
+}
+
+/*
+ * clocksource_init()
+ *   DESCRIPTION: Measures the TSC rate by counting cycles across about 50ms
+ *                of PIT channel 0 counting down in one-shot mode, then works
+ *                out the timer period from timeslice_ms. Must run before
+ *                PIT_init, with interrupts off.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Reprograms PIT channel 0. Starts the clock at zero.
+ */
+void clocksource_init()
+{
+    uint64_t start_tsc;
+    uint64_t end_tsc;
+    uint16_t start_count;
+    uint16_t count;
+
+    outb(PIT_ONESHOT_CH0, COMMAND_REGISTER);
+    outb(0xFF, CHANNEL_0_DATA_REGISTER);
+    outb(0xFF, CHANNEL_0_DATA_REGISTER);
+
+    start_count = pit_read_count();
+    start_tsc = rdtsc64();
+    do {
+        count = pit_read_count();
+    } while ((uint16_t)(start_count - count) < CALIBRATE_PIT_TICKS);
+    end_tsc = rdtsc64();
+
+    tsc_khz = div64_32((end_tsc - start_tsc) * PIT_HZ,
+        (uint32_t)(uint16_t)(start_count - count) * 1000);
+    if (tsc_khz == 0) {
+        tsc_khz = 1;
+    }
+
+    // Largest shift that keeps the multiplier within 32 bits.
+    clock_shift = 32;
+    while (clock_shift > 0 && ((uint64_t)tsc_khz << (32 - clock_shift)) <= 1000000) {
+        clock_shift--;
+    }
+    clock_mult = div64_32((uint64_t)1000000 << clock_shift, tsc_khz);
+
+    if (timeslice_ms == 0) {
+        timeslice_ms = TIMESLICE_DEFAULT_MS;
+    } else if (timeslice_ms > TIMESLICE_MAX_MS) {
+        timeslice_ms = TIMESLICE_MAX_MS;
+    }
+    pit_divisor = PIT_HZ * timeslice_ms / 1000;
+    timer_divisor = pit_divisor;
+    timer_max_count = PIT_MAX_COUNT;
+    tick_period_ns = div64_32((uint64_t)pit_divisor * 1000000000, PIT_HZ);
+    tsc_per_tick = div64_32((uint64_t)tsc_khz * tick_period_ns, NS_PER_MS);
+    if (tsc_per_tick == 0) {
+        tsc_per_tick = 1;
+    }
+
+    clock_base_tsc = rdtsc64();
+    clock_base_ns = 0;
+    tick_mark_tsc = clock_base_tsc;
+
+    vdso_write_begin();
+    vdso->tick_period_ns = tick_period_ns;
+    vdso->tsc_khz = tsc_khz;
+    vdso->clock_mult = clock_mult;
+    vdso->clock_shift = clock_shift;
+    vdso->base_tsc = clock_base_tsc;
+    vdso->base_ns = clock_base_ns;
+    vdso->rebase_cycles = CLOCK_REBASE_CYCLES;
+    vdso->rebase_ns = cycles_to_ns(CLOCK_REBASE_CYCLES);
+    vdso_write_end();
+}
+
+/*
+ * cycles_to_ns(uint32_t cycles)
+ *   DESCRIPTION: Converts a TSC interval to nanoseconds.
+ *   INPUTS: uint32_t cycles - the interval.
+ *   OUTPUTS: none
+ *   RETURN VALUE: The interval in nanoseconds, 0 before calibration.
+ *   SIDE EFFECTS: none
+ */
+uint64_t cycles_to_ns(uint32_t cycles)
+{
+    return ((uint64_t)cycles * clock_mult) >> clock_shift;
+}
+
+/*
+ * clock_ns()
+ *   DESCRIPTION: Reads the kernel clock.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: Nanoseconds since clocksource_init.
+ *   SIDE EFFECTS: Moves the clock's base up every CLOCK_REBASE_CYCLES, so
+ *                 conversions stay within 32 bits, and publishes it to the
+ *                 vdso page.
+ */
+uint64_t clock_ns()
+{
+    int flags = 0;
+    uint64_t delta;
+    uint64_t ns;
+
+    cli_and_save(flags);
+    delta = rdtsc64() - clock_base_tsc;
+    if (delta >= CLOCK_REBASE_CYCLES) {
+        while (delta >= CLOCK_REBASE_CYCLES) {
+            clock_base_tsc += CLOCK_REBASE_CYCLES;
+            clock_base_ns += cycles_to_ns(CLOCK_REBASE_CYCLES);
+            delta -= CLOCK_REBASE_CYCLES;
+        }
+        // Processes read the clock from the same base.
+        vdso_write_begin();
+        vdso->base_tsc = clock_base_tsc;
+        vdso->base_ns = clock_base_ns;
+        vdso_write_end();
+    }
+    ns = clock_base_ns + cycles_to_ns((uint32_t)delta);
+    restore_flags(flags);
+
+    return ns;
+}
+
+/*
+ * clock_ms()
+ *   DESCRIPTION: Reads the kernel clock in milliseconds.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: Milliseconds since clocksource_init.
+ *   SIDE EFFECTS: See clock_ns.
+ */
+uint32_t clock_ms()
+{
+    return div64_32(clock_ns(), NS_PER_MS);
+}
+
+/*
+ * clock_take_ticks()
+ *   DESCRIPTION: Counts the timer ticks that have gone by since the last
+ *                call. Ticks stay on a fixed grid of tsc_per_tick cycles
+ *                however irregularly this is called, so the timer can skip
+ *                interrupts it has no use for.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: Whole ticks elapsed.
+ *   SIDE EFFECTS: Moves the tick mark up by that many ticks.
+ */
+uint32_t clock_take_ticks()
+{
+    int64_t delta = (int64_t)(rdtsc64() - tick_mark_tsc);
+    uint32_t ticks;
+
+    // A tick counted a little early leaves the mark just ahead of now.
+    if (delta < 0) {
+        return 0;
+    }
+    ticks = div64_32((uint64_t)delta + (tsc_per_tick >> TICK_SLACK_SHIFT), tsc_per_tick);
+    tick_mark_tsc += (uint64_t)ticks * tsc_per_tick;
+    return ticks;
+}
+
+/*
+ * clock_timer_count(uint32_t ticks)
+ *   DESCRIPTION: Works out the one-shot count of the tick timer, the PIT or
+ *                the local APIC timer, that fires an interrupt on the given
+ *                tick after the tick mark.
+ *   INPUTS: uint32_t ticks - ticks after the mark, at most
+ *                            timer_max_count / timer_divisor.
+ *   OUTPUTS: none
+ *   RETURN VALUE: The count, between 1 and timer_max_count.
+ *   SIDE EFFECTS: none
+ */
+uint32_t clock_timer_count(uint32_t ticks)
+{
+    uint64_t deadline = tick_mark_tsc + (uint64_t)ticks * tsc_per_tick;
+    uint64_t now = rdtsc64();
+    uint32_t count;
+
+    if (deadline <= now) {
+        return 1;
+    }
+    count = div64_32((deadline - now) * timer_divisor, tsc_per_tick);
+    if (count == 0) {
+        count = 1;
+    } else if (count > timer_max_count) {
+        count = timer_max_count;
+    }
+    return count;
+}
+
+/*
+ * clock_peek_ticks()
+ *   DESCRIPTION: Counts the whole timer ticks since the last clock_take_ticks
+ *                without taking them, so tick_count plus this is the
+ *                current tick even between timer interrupts.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: Whole ticks elapsed.
+ *   SIDE EFFECTS: none
+ */
+uint32_t clock_peek_ticks()
+{
+    int64_t delta = (int64_t)(rdtsc64() - tick_mark_tsc);
+
+    if (delta < 0) {
+        return 0;
+    }
+    return div64_32((uint64_t)delta, tsc_per_tick);
+}
+
+/*
+ * ns_to_ticks(uint64_t ns)
+ *   DESCRIPTION: Converts a timeout to timer ticks, rounding up.
+ *   INPUTS: uint64_t ns - the timeout in nanoseconds.
+ *   OUTPUTS: none
+ *   RETURN VALUE: Ticks, at most MAX_TIMEOUT_TICKS.
+ *   SIDE EFFECTS: none
+ */
+uint32_t ns_to_ticks(uint64_t ns)
+{
+    uint32_t ticks;
+
+    ns += tick_period_ns - 1;
+    // The quotient of a divl has to fit in 32 bits.
+    if ((uint32_t)(ns >> 32) >= tick_period_ns) {
+        return MAX_TIMEOUT_TICKS;
+    }
+    ticks = div64_32(ns, tick_period_ns);
+    return (ticks > MAX_TIMEOUT_TICKS) ? MAX_TIMEOUT_TICKS : ticks;
+}
@@ -0,0 +1,35 @@
+/* clocksource.h - TSC timebase calibrated against the PIT.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#include "types.h"
+
+#define PIT_HZ                  1193182     // Input clock of the PIT.
+#define PIT_LATCH_CH0           0x00        // Command latching channel 0's count.
+#define PIT_ONESHOT_CH0         0x30        // Channel 0, low then high byte, mode 0.
+#define CALIBRATE_PIT_TICKS     59659       // About 50ms of PIT input clocks.
+#define TIMESLICE_DEFAULT_MS    10          // Timer period without a timeslice= boot option.
+#define TIMESLICE_MAX_MS        54          // Longest period the 16-bit divisor allows.
+#define NS_PER_MS               1000000
+#define CLOCK_REBASE_CYCLES     0x80000000  // Cycles the clock runs before its base is moved up.
+#define PIT_MAX_COUNT           0xFFFF      // Largest one-shot count.
+#define TICK_SLACK_SHIFT        3           // An interrupt up to 1/8 tick early still counts the tick.
+#define MAX_TIMEOUT_TICKS       0x7FFFFFFF  // Longest timeout, so tick comparisons stay signed-safe.
+
+uint32_t tsc_khz;           // TSC rate measured at boot.
+uint32_t timeslice_ms;      // Timer period from the command line, 0 for the default.
+uint32_t pit_divisor;       // PIT channel 0 divisor for the timer period.
+uint32_t timer_divisor;     // Counts of the tick timer, PIT or local APIC, in a tick.
+uint32_t timer_max_count;   // Largest one-shot count of the tick timer.
+uint32_t tick_period_ns;    // Exact length of a timer tick.
+uint32_t tsc_per_tick;      // TSC cycles in a timer tick.
+
+extern void clocksource_init();
+extern uint64_t clock_ns();
+extern uint64_t cycles_to_ns(uint32_t cycles);
+extern uint32_t clock_ms();
+extern uint32_t clock_take_ticks();
+extern uint32_t clock_timer_count(uint32_t ticks);
+extern uint32_t clock_peek_ticks();
+extern uint32_t ns_to_ticks(uint64_t ns);
@@ -183,13 +183,32 @@ void exception_segment_not_present(){
 /*
  * exception_page_fault
  *   DESCRIPTION: Exception handler which is called when there is a page fault
- *   exception. Will print the exception and wait forever.
- *   INPUTS: none
+ *   exception. Faults on not-present pages of the program region are demand
+ *   paging faults and are resolved by filling in the page. Anything else
+ *   will print the exception and halt the process.
+ *   INPUTS: uint32_t error_code - error code pushed by the processor
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Waits forever
+ *   SIDE EFFECTS: Maps a program page, or halts the process
  */
-void exception_page_fault(){
+void exception_page_fault(uint32_t error_code){
+    uint32_t addr;
+    int locked;
+
+    /** CR2 holds the faulting address */
+    asm volatile ("movl %%cr2, %0"
+            : "=r" (addr)
+            );
+
+    // Filling in a page takes frames and reads the file system.
+    locked = lock_kernel();
+    exec_first_event(current_pid);
+    if (!(error_code & PF_PRESENT) && fault_program_page(current_pid, addr) == SUCCESS) {
+        unlock_kernel(locked);
+        return;
+    }
+    unlock_kernel(locked);
+
     printf("Exception: Page Fault\n");
     // while(1){}
     int status = 256;
@@ -6,6 +6,8 @@
 #include "terminal.h"
 #include "syscalls.h"
 
+#define PF_PRESENT  0x1     // Page fault error code bit: page was present.
+
 extern void exception_div_zero();
 extern void exception_debug();
 extern void exception_nonmaskable_interrupt();
@@ -20,7 +22,7 @@ extern void exception_invalid_TSS();
 extern void exception_segment_not_present();
 extern void exception_stack_segment_fault();
 extern void exception_general_protection_fault();
-extern void exception_page_fault();
+extern void exception_page_fault(uint32_t error_code);
 extern void exception_reserved();
 extern void exception_x87_floating_point();
 extern void exception_alignment_check();
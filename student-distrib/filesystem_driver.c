@@ -5,6 +5,73 @@
 
 static boot_block_t *casted_block; //boot block of filesystem
 
+/* Open-addressing index over the dentry filenames, built at boot. Each slot
+ * holds a dir_entries index (or DENTRY_HASH_EMPTY) and the full hash of that
+ * name, so most probes are rejected without touching the dentry. */
+static int8_t dentry_hash_index[DENTRY_HASH_SIZE];
+static uint32_t dentry_hash_value[DENTRY_HASH_SIZE];
+
+/*
+ *   dentry_hash
+ *   DESCRIPTION: FNV-1a hash of a filename, stopping at the terminating null
+ *   or after FILENAME_SIZE characters, whichever comes first
+ *   INPUTS: const int8_t* name: the filename
+ *   OUTPUTS: none
+ *   RETURN VALUE: the 32 bit hash of the name
+ *   SIDE EFFECTS: none
+ */
+static uint32_t dentry_hash(const int8_t* name)
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+    int i;
+
+    for (i = 0; i < FILENAME_SIZE && name[i] != '\0'; i++)
+    {
+        hash ^= (uint8_t)name[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/*
+ *   dentry_hash_init
+ *   DESCRIPTION: Builds the filename index over every used directory entry.
+ *   Entries are inserted in directory order, so when two entries share a
+ *   name the first one is found first, as with a linear scan.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: fills dentry_hash_index and dentry_hash_value
+ */
+static void dentry_hash_init()
+{
+    int i;
+    uint32_t hash;
+    uint32_t slot;
+
+    for (i = 0; i < DENTRY_HASH_SIZE; i++)
+    {
+        dentry_hash_index[i] = DENTRY_HASH_EMPTY;
+        dentry_hash_value[i] = 0;
+    }
+
+    for (i = 0; i < MAX_DIR_ENTRIES; i++)
+    {
+        if (casted_block->dir_entries[i].filename[0] == '\0') {
+            continue;
+        }
+
+        /** linear probe to the first free slot */
+        hash = dentry_hash((int8_t *)casted_block->dir_entries[i].filename);
+        slot = hash & (DENTRY_HASH_SIZE - 1);
+        while (dentry_hash_index[slot] != DENTRY_HASH_EMPTY) {
+            slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
+        }
+        dentry_hash_index[slot] = i;
+        dentry_hash_value[slot] = hash;
+    }
+}
+
 /*
  *   boot_block_init
  *   DESCRIPTION: Initializes structs to represent the filesystem at the passed
@@ -20,6 +87,9 @@ void boot_block_init(unsigned int addr)
     casted_block = (boot_block_t *)addr;
     node_list = (node_block_t *)(addr + FILE_SIZE);
     data_list = (data_block_t *)(addr + FILE_SIZE + (casted_block->inodes * FILE_SIZE));
+
+    /** Index the filenames so lookups by name do not scan the directory */
+    dentry_hash_init();
 }
 
 /*
@@ -33,31 +103,32 @@ void boot_block_init(unsigned int addr)
  */
 int32_t read_dentry_by_name(const uint8_t *fname, dir_entry_t *dentry)
 {
-    if (strlen((const int8_t*)fname) == 0) {
+    uint32_t hash;  /** hash of the requested name */
+    uint32_t slot;  /** current probe slot */
+    int index;      /** dir_entries index stored in the slot */
+
+    if (fname == NULL || fname[0] == '\0') {
         return FAILURE;
     }
-    if (strlen((const int8_t*)fname) > 32) {
+    if (strlen((const int8_t*)fname) > FILENAME_SIZE) {
         return FAILURE;
     }
 
-    int i = 0;
-    /** Iterate over all the d_entries */
-    for (i = 0; i < MAX_DIR_ENTRIES; i++)
+    /** Probe from the home slot; an empty slot means the name is not there */
+    hash = dentry_hash((const int8_t *)fname);
+    slot = hash & (DENTRY_HASH_SIZE - 1);
+    while ((index = dentry_hash_index[slot]) != DENTRY_HASH_EMPTY)
     {
-        /** Check to see if the filename exists. */
-        int8_t *current_filename = (int8_t *)casted_block->dir_entries[i].filename;
-        if (current_filename[0] == '\0') {
-            continue;
-        }
-
-        /** If the names are the same, set the dentry and return 0 */
-        if (0 == strncmp(current_filename, (char *)fname, FILENAME_SIZE))
+        /** Only compare names whose full hashes match */
+        if (dentry_hash_value[slot] == hash &&
+            0 == strncmp((int8_t *)casted_block->dir_entries[index].filename, (int8_t *)fname, FILENAME_SIZE))
         {
-            *dentry = casted_block->dir_entries[i];
+            *dentry = casted_block->dir_entries[index];
             return SUCCESS;
         }
-
+        slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
     }
+
     /** If none are found, return -1 */
     return FAILURE;
 }
@@ -90,74 +161,114 @@ int32_t read_dentry_by_index(unsigned int index, dir_entry_t *dentry)
 }
 
 /*
- * read_data
- *   DESCRIPTION: reads data in a file by looking at the providede inode and offset
- *   and length of desired data wanted and writes it into a buffer passed into the function
- *   INPUTS: uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length
- *   OUTPUTS: copies file data into the buffer
- *   RETURN VALUE: 0 on success, -1 on failure
+ * fetch_data_block
+ *   DESCRIPTION: looks up the data block holding the given block index of an
+ *   inode and checks that it lies inside the filesystem image
+ *   INPUTS: uint32_t inode, uint32_t block_index
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the start of the block, NULL if it is invalid
  *   SIDE EFFECTS: none
  */
-int32_t read_data (uint32_t fd, uint32_t offset, uint8_t* buf, uint32_t length)
+uint8_t * fetch_data_block(uint32_t inode, uint32_t block_index)
+{
+    uint32_t block_num = node_list[inode].data_blocks[block_index];
+
+    if (block_num >= casted_block->data_blocks) {
+        return NULL;
+    }
+    return (uint8_t *) &data_list[block_num];
+}
+
+/*
+ * read_data_run
+ *   DESCRIPTION: copies a run of file data into a buffer a block at a time.
+ *   The partial head block, every whole block and the tail are each moved
+ *   with a single memcpy. If a cursor is passed in, the block it caches is
+ *   reused when the read starts inside it, and the cursor is left pointing at
+ *   the block the next sequential read will start in.
+ *   INPUTS: uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length,
+ *   fd_block_t* cursor (may be NULL)
+ *   OUTPUTS: copies file data into the buffer
+ *   RETURN VALUE: number of bytes copied (0 at end of file), -1 on failure
+ *   SIDE EFFECTS: updates the cursor's cached block
+ */
+static int32_t read_data_run(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length, fd_block_t* cursor)
 {
-    uint32_t max_inodes;    /** max amount of inodes */
-    unsigned int curr;      /** variable to be used to access the index of data_pointer */
-    uint32_t num;           /** length of data in inode */
-    uint8_t* data_pointer;  /** pointer used for accessing file data */
-    int i;                  /** loop iteration variable */
-    int j;                  /** loop iteration variable */
-    int loop;               /** var to switch data blocks */
-    uint32_t inode;         /** inode num from fd */
-    inode = control_blocks[current_pid].fd_table[fd].inode;
+    uint32_t file_length;   /** length of the file in bytes */
+    uint32_t block_index;   /** index into the inode's data_blocks */
+    uint32_t block_offset;  /** offset inside the current block */
+    uint32_t copied;        /** bytes copied so far */
+    uint32_t run;           /** bytes to copy out of the current block */
+    uint8_t* block;         /** start of the current data block */
+
     /** if inode out of range, return -1 */
-    max_inodes = casted_block->inodes;
-    if (inode > max_inodes) {
+    if (inode >= casted_block->inodes) {
         return -1;
     }
-    curr = node_list[inode].data_blocks[offset / FILE_SIZE];
-    num = node_list[inode].B_length;
-    if (num == 0) {
 
+    /** clamp the read to the end of the file */
+    file_length = node_list[inode].B_length;
+    if (offset >= file_length) {
         return 0;
     }
+    if (length > file_length - offset) {
+        length = file_length - offset;
+    }
 
-	if(control_blocks[current_pid].fd_table[fd].file_position > num){
-		return 0;
-	}
-    /** initalizes variablies used for loop iteration */
-    data_pointer =(uint8_t*) &data_list[curr];
-    i = 0;
-    j = offset % FILE_SIZE;
-    loop = offset/FILE_SIZE;
-    while (length != i)
+    block_index = offset / FILE_SIZE;
+    block_offset = offset % FILE_SIZE;
+
+    /** reuse the cached block if the read starts inside it */
+    if (cursor != NULL && cursor->block_data != NULL && cursor->block_index == block_index) {
+        block = cursor->block_data;
+    } else {
+        block = fetch_data_block(inode, block_index);
+    }
+    if (block == NULL) {
+        return -1;
+    }
+
+    copied = 0;
+    while (copied < length)
     {
-        if (i == num) {
-            /* If reading one character too short uncomment */
-            //if not good uncomment
-            buf[i] = data_pointer[j];
-            control_blocks[current_pid].fd_table[fd].file_position += i;
-            return i;
+        run = FILE_SIZE - block_offset;
+        if (run > length - copied) {
+            run = length - copied;
         }
-
-	if(control_blocks[current_pid].fd_table[fd].file_position + i >= num){
-		return 0;
-	}
-        /** copies data into buffer */
-        buf[i] = data_pointer[j];
-        i++;
-		j++;
-
-        /** if in first data block and at end, switch to next data block */
-        /** if at end of file, switch to next data block */
-        if ((j % FILE_SIZE) == 0) {
-            j = 0;
-            loop += 1;
-            data_pointer = (uint8_t*) &data_list[node_list[inode].data_blocks[loop]];
+        memcpy(buf + copied, block + block_offset, run);
+        copied += run;
+        block_offset += run;
+
+        /** step to the next block once this one is used up */
+        if (block_offset == FILE_SIZE && offset + copied < file_length) {
+            block_index++;
+            block_offset = 0;
+            block = fetch_data_block(inode, block_index);
+            if (block == NULL) {
+                return -1;
+            }
         }
     }
-    /** returns number of bytes read and placed in the buffer success */
-    control_blocks[current_pid].fd_table[fd].file_position += i;
-    return i;
+
+    if (cursor != NULL) {
+        cursor->block_index = block_index;
+        cursor->block_data = block;
+    }
+    return copied;
+}
+
+/*
+ * read_data
+ *   DESCRIPTION: reads data in a file by looking at the provided inode and offset
+ *   and length of desired data wanted and writes it into a buffer passed into the function
+ *   INPUTS: uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length
+ *   OUTPUTS: copies file data into the buffer
+ *   RETURN VALUE: number of bytes read (0 at end of file), -1 on failure
+ *   SIDE EFFECTS: none
+ */
+int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length)
+{
+    return read_data_run(inode, offset, buf, length, NULL);
 }
 
 
@@ -176,6 +287,8 @@ int32_t file_open(const uint8_t * filename)
     int32_t open;           /** keeps track of open spot on pcb */
     dir_entry_t dentry; /** used to store inodes in pcb */
     fd_block_t fblock; /** file descriptor block to be assigned */
+    pcb_t * pcb = &control_blocks[current_pid];
+    int flags = 0;
     ret = 0;
     i = 0;
     open = 0;
@@ -186,16 +299,18 @@ int32_t file_open(const uint8_t * filename)
     if (ret == -1) {
         return ret;
     }
+    spin_lock_irqsave(&pcb->fd_lock, flags);
     for (i = 2; i < FDT_SIZE; i++)
     {
         /** the control block is empty, take it */
-        if (control_blocks[current_pid].fd_table[i].flags == -1) {
+        if (pcb->fd_table[i].flags == -1) {
             open = i;
             break;
         }
 
         /** If there is not anavailable spot, return -1 */
         if (i == FDT_SIZE) {
+            spin_unlock_irqrestore(&pcb->fd_lock, flags);
             return -1;
         }
     }
@@ -203,8 +318,11 @@ int32_t file_open(const uint8_t * filename)
     fblock.inode = dentry.inode_num;
     fblock.file_position = 0;
     fblock.flags = 1;
+    fblock.block_index = 0;
+    fblock.block_data = NULL;
     // Set flags and file position?
-    control_blocks[current_pid].fd_table[open] =  fblock;
+    pcb->fd_table[open] =  fblock;
+    spin_unlock_irqrestore(&pcb->fd_lock, flags);
     return open;
 }
 
@@ -218,18 +336,23 @@ int32_t file_open(const uint8_t * filename)
  */
 int32_t file_close(int32_t fd)
 {
+    pcb_t * pcb = &control_blocks[current_pid];
+    int flags = 0;
     /** check for fd validity */
     if (fd < 2 || fd >= FDT_SIZE) {
         return -1;
     }
-    if (control_blocks[current_pid].fd_table[fd].flags == -1) {
+    spin_lock_irqsave(&pcb->fd_lock, flags);
+    if (pcb->fd_table[fd].flags == -1) {
+        spin_unlock_irqrestore(&pcb->fd_lock, flags);
         return -1;
     }
 
     /** set the control block entry to -1 */
-    control_blocks[current_pid].fd_table[fd].file_operations_pointer = NULL;
-    control_blocks[current_pid].fd_table[fd].flags = -1;
-    control_blocks[current_pid].fd_table[fd].inode = -1;
+    pcb->fd_table[fd].file_operations_pointer = NULL;
+    pcb->fd_table[fd].flags = -1;
+    pcb->fd_table[fd].inode = -1;
+    spin_unlock_irqrestore(&pcb->fd_lock, flags);
     return 0;
 }
 
@@ -256,8 +379,19 @@ int32_t file_write(int32_t fd, const void* buf, int32_t nbytes)
  */
 int32_t file_read(int32_t fd, void* buf, int32_t nbytes)
 {
-    /** calls read data function into the buffer */
-    return read_data(fd, control_blocks[current_pid].fd_table[fd].file_position, (uint8_t *)buf, nbytes);
+    int32_t ret;
+    fd_block_t* fblock = &control_blocks[current_pid].fd_table[fd];
+
+    if (nbytes < 0) {
+        return -1;
+    }
+
+    /** calls read data function into the buffer, reusing the fd's block cursor */
+    ret = read_data_run(fblock->inode, fblock->file_position, (uint8_t *)buf, nbytes, fblock);
+    if (ret > 0) {
+        fblock->file_position += ret;
+    }
+    return ret;
 }
 
 /*
@@ -275,6 +409,8 @@ int32_t directory_open(const uint8_t * filename)
     int32_t open;           /** keeps track of open spot on pcb */
     dir_entry_t dentry; /** used to store inodes in pcb */
     fd_block_t  fblock;
+    pcb_t * pcb = &control_blocks[current_pid];
+    int flags = 0;
     // dentryRead = 0;
     ret = 0;
     i = 0;
@@ -287,14 +423,16 @@ int32_t directory_open(const uint8_t * filename)
     }
 
     /** Search for an open control block and populate it */
+    spin_lock_irqsave(&pcb->fd_lock, flags);
     for (i = 2; i < FDT_SIZE; i++)
     {
-        if (control_blocks[current_pid].fd_table[i].flags == -1) {
+        if (pcb->fd_table[i].flags == -1) {
             open = i;
             break;
         }
 
         if (i == FDT_SIZE - 1) {
+            spin_unlock_irqrestore(&pcb->fd_lock, flags);
             return -1;
         }
     }
@@ -303,7 +441,10 @@ int32_t directory_open(const uint8_t * filename)
     fblock.file_position = 0;
     fblock.inode = 0;
     fblock.flags = casted_block->num_dir_entries;
-    control_blocks[current_pid].fd_table[open] = fblock;
+    fblock.block_index = 0;
+    fblock.block_data = NULL;
+    pcb->fd_table[open] = fblock;
+    spin_unlock_irqrestore(&pcb->fd_lock, flags);
     /** return the control block index */
     return open;
 }
@@ -318,19 +459,24 @@ int32_t directory_open(const uint8_t * filename)
  */
 int32_t directory_close(int32_t fd)
 {
+    pcb_t * pcb = &control_blocks[current_pid];
+    int flags = 0;
 
     /** Check for fd validity */
     if (fd < 2 || fd >= FDT_SIZE) {
         return -1;
     }
-    if (control_blocks[current_pid].fd_table[fd].flags == -1) {
+    spin_lock_irqsave(&pcb->fd_lock, flags);
+    if (pcb->fd_table[fd].flags == -1) {
+        spin_unlock_irqrestore(&pcb->fd_lock, flags);
         return -1;
     }
 
     /** Clear the control block entry */
-    control_blocks[current_pid].fd_table[fd].file_operations_pointer = NULL;
-    control_blocks[current_pid].fd_table[fd].flags = -1;
-    control_blocks[current_pid].fd_table[fd].inode = -1;
+    pcb->fd_table[fd].file_operations_pointer = NULL;
+    pcb->fd_table[fd].flags = -1;
+    pcb->fd_table[fd].inode = -1;
+    spin_unlock_irqrestore(&pcb->fd_lock, flags);
     return 0;
 }
 
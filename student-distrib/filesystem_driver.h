@@ -14,6 +14,11 @@
 #define FILENAME_SIZE       32      // Filename size.
 #define IN_USE              1
 
+#define DENTRY_HASH_SIZE    128         // Filename index slots, a power of two at least twice MAX_DIR_ENTRIES.
+#define DENTRY_HASH_EMPTY   -1          // Marks an unused filename index slot.
+#define FNV_OFFSET_BASIS    0x811C9DC5  // FNV-1a hash seed.
+#define FNV_PRIME           0x01000193  // FNV-1a hash multiplier.
+
 // Directory Entry Structure.
 typedef struct dir_entry
 {
@@ -62,6 +67,7 @@ extern int32_t read_dentry_by_name(const uint8_t *fname, dir_entry_t *dentry);
 extern int32_t read_dentry_by_index(unsigned int index, dir_entry_t *dentry);
 
 extern int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+extern uint8_t * fetch_data_block(uint32_t inode, uint32_t block_index);
 
 extern int32_t file_open(const uint8_t * filename);
 extern int32_t file_close(int32_t fd);
@@ -0,0 +1,166 @@
+/* frame_allocator.c - Physical page frame allocator.
+ * vim:ts=4 noexpandtab
+ */
+#include "frame_allocator.h"
+
+// One bit per 4kB frame, set when the frame is in use or not usable RAM.
+static uint32_t frame_bitmap[FRAME_WORDS];
+// Word to start the next search from.
+static uint32_t frame_hint;
+
+// Bit of a frame within its bitmap word, and whether the frame is in use.
+#define FRAME_BIT(frame)    ((uint32_t)1 << ((frame) % FRAME_WORD_BITS))
+#define FRAME_USED(frame)   (frame_bitmap[(frame) / FRAME_WORD_BITS] & FRAME_BIT(frame))
+
+/*
+ * frames_init()
+ *   DESCRIPTION: Marks every frame as in use. Usable memory is handed to the
+ *                allocator afterwards with frames_add_region.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Clears the frame counts.
+ */
+void frames_init()
+{
+    uint32_t i;
+    for (i = 0; i < FRAME_WORDS; i++)
+    {
+        frame_bitmap[i] = FRAME_WORD_FULL;
+    }
+    frame_hint = 0;
+    total_frames = 0;
+    free_frames = 0;
+}
+
+/*
+ * frames_add_region(uint32_t base, uint32_t length)
+ *   DESCRIPTION: Frees every whole frame of a region of usable RAM reported
+ *                by the boot loader. Frames below FRAME_FLOOR or at or above
+ *                FRAME_LIMIT are skipped.
+ *   INPUTS: uint32_t base - physical address of the region.
+ *           uint32_t length - length of the region in bytes.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Adds the region's frames to the free frames.
+ */
+void frames_add_region(uint32_t base, uint32_t length)
+{
+    uint32_t first;     // First whole frame of the region.
+    uint32_t last;      // One past the last whole frame of the region.
+
+    first = (base + FRAME_SIZE - 1) >> FRAME_SHIFT;
+    if (base + length < base || base + length > FRAME_LIMIT) {
+        last = MAX_FRAMES;
+    } else {
+        last = (base + length) >> FRAME_SHIFT;
+    }
+    if (first < (FRAME_FLOOR >> FRAME_SHIFT)) {
+        first = FRAME_FLOOR >> FRAME_SHIFT;
+    }
+
+    for (; first < last; first++)
+    {
+        if (FRAME_USED(first)) {
+            frame_bitmap[first / FRAME_WORD_BITS] &= ~FRAME_BIT(first);
+            total_frames++;
+            free_frames++;
+        }
+    }
+}
+
+/*
+ * frames_reserve(uint32_t start, uint32_t end)
+ *   DESCRIPTION: Takes the frames overlapping [start, end) out of the
+ *                allocator, for memory the boot loader placed in usable RAM.
+ *   INPUTS: uint32_t start - first physical address to reserve.
+ *           uint32_t end - one past the last physical address to reserve.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Removes the frames from the free frames.
+ */
+void frames_reserve(uint32_t start, uint32_t end)
+{
+    uint32_t frame;
+    uint32_t last;
+
+    last = (end + FRAME_SIZE - 1) >> FRAME_SHIFT;
+    if (last > MAX_FRAMES) {
+        last = MAX_FRAMES;
+    }
+
+    for (frame = start >> FRAME_SHIFT; frame < last; frame++)
+    {
+        if (!FRAME_USED(frame)) {
+            frame_bitmap[frame / FRAME_WORD_BITS] |= FRAME_BIT(frame);
+            total_frames--;
+            free_frames--;
+        }
+    }
+}
+
+/*
+ * frame_alloc()
+ *   DESCRIPTION: Hands out a free 4kB frame. The search picks up where the
+ *                last one stopped and skips full bitmap words at a time.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: Physical address of the frame, or FRAME_NONE if memory
+ *                 has run out.
+ *   SIDE EFFECTS: Marks the frame in use. The frame's contents are not cleared.
+ */
+uint32_t frame_alloc()
+{
+    uint32_t i;
+    uint32_t word;
+    uint32_t bit;
+
+    if (free_frames == 0) {
+        return FRAME_NONE;
+    }
+
+    for (i = 0; i < FRAME_WORDS; i++)
+    {
+        word = (frame_hint + i) % FRAME_WORDS;
+        if (frame_bitmap[word] == FRAME_WORD_FULL) {
+            continue;
+        }
+
+        for (bit = 0; bit < FRAME_WORD_BITS; bit++)
+        {
+            if (!(frame_bitmap[word] & ((uint32_t)1 << bit))) {
+                break;
+            }
+        }
+        frame_bitmap[word] |= (uint32_t)1 << bit;
+        frame_hint = word;
+        free_frames--;
+        return (word * FRAME_WORD_BITS + bit) << FRAME_SHIFT;
+    }
+
+    return FRAME_NONE;
+}
+
+/*
+ * frame_free(uint32_t addr)
+ *   DESCRIPTION: Returns a frame from frame_alloc to the allocator.
+ *   INPUTS: uint32_t addr - physical address of the frame.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Marks the frame free. Frames that are already free, or
+ *                 lie in the kernel's memory, are ignored.
+ */
+void frame_free(uint32_t addr)
+{
+    uint32_t frame = addr >> FRAME_SHIFT;
+
+    if (addr < FRAME_FLOOR || frame >= MAX_FRAMES) {
+        return;
+    }
+    if (!FRAME_USED(frame)) {
+        return;
+    }
+
+    frame_bitmap[frame / FRAME_WORD_BITS] &= ~FRAME_BIT(frame);
+    free_frames++;
+}
@@ -0,0 +1,26 @@
+/* frame_allocator.h - Physical page frame allocator.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#include "types.h"
+
+#define FRAME_SHIFT     12          // Shift between a physical address and its frame number.
+#define FRAME_SIZE      0x1000      // Bytes in a frame.
+#define FRAME_FLOOR     0x800000    // Everything below belongs to the kernel and is never handed out.
+#define FRAME_LIMIT     0x40000000  // Memory above this is left unused.
+#define MAX_FRAMES      (FRAME_LIMIT >> FRAME_SHIFT)
+#define FRAME_WORD_BITS 32          // Frames tracked per bitmap word.
+#define FRAME_WORDS     (MAX_FRAMES / FRAME_WORD_BITS)
+#define FRAME_WORD_FULL 0xFFFFFFFF  // Every frame in the word is in use.
+#define FRAME_NONE      0           // Returned by frame_alloc when memory runs out.
+
+// Frame counts, kept up to date by the allocator.
+uint32_t total_frames;
+uint32_t free_frames;
+
+extern void frames_init();
+extern void frames_add_region(uint32_t base, uint32_t length);
+extern void frames_reserve(uint32_t start, uint32_t end);
+extern uint32_t frame_alloc();
+extern void frame_free(uint32_t addr);
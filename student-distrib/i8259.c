@@ -5,6 +5,7 @@
 #include "i8259.h"
 #include "lib.h"
 #include "communication.h"
+#include "apic.h"
 /* Interrupt masks to determine which interrupts are enabled and disabled */
 uint8_t master_mask; /* IRQs 0-7  */
 uint8_t slave_mask;  /* IRQs 8-15 */
@@ -44,11 +45,16 @@ void i8259_init(void) {
  * Inputs:      NONE
  * Outputs:     NONE
  * Return Value: NONE
- * Side Effects:  Desired IRQ on the PIC can now take interrupts
+ * Side Effects:  Desired IRQ on the PIC can now take interrupts. Goes to
+ *                the IOAPIC instead once apic_irq_init has moved IRQs there.
  */
 void enable_irq(uint32_t irq_num) {
 	uint16_t port;
   uint8_t val;
+  if(apic_irqs){
+    ioapic_unmask(irq_num);
+    return;
+  }
   if(irq_num < 8){
     port = MASTER_8259_PORT + 1;
     val = inb(port) & ~(1 << irq_num);
@@ -68,11 +74,16 @@ void enable_irq(uint32_t irq_num) {
  * Inputs:      NONE
  * Outputs:     NONE
  * Return Value: NONE
- * Side Effects:  Desired IRQ on PIC can no longer accept interrupts
+ * Side Effects:  Desired IRQ on PIC can no longer accept interrupts. Goes
+ *                to the IOAPIC instead once apic_irq_init has moved IRQs there.
  */
 void disable_irq(uint32_t irq_num) {
 	uint16_t port;
   uint8_t val;
+  if(apic_irqs){
+    ioapic_mask(irq_num);
+    return;
+  }
   if(irq_num < 8){
     port = MASTER_8259_PORT + 1;
     val = inb(port) | (1 << irq_num);
@@ -92,9 +103,14 @@ void disable_irq(uint32_t irq_num) {
  * Inputs:      NONE
  * Outputs:     NONE
  * Return Value: NONE
- * Side Effects:  Will reenable interrupts on the PIC
+ * Side Effects:  Will reenable interrupts on the PIC. With the APIC, one
+ *                write to the local APIC instead of one or two port writes.
  */
 void send_eoi(uint32_t irq_num) {
+  if(apic_irqs){
+    lapic_eoi();
+    return;
+  }
   if(irq_num < 8){
     outb(EOI | (irq_num& 0x07), MASTER_8259_PORT);
   }
@@ -12,26 +12,33 @@
 #include "rtc_driver.h"
 #include "keyboard.h"
 #include "keyboard_wrapper.h"
+#include "page_fault_wrapper.h"
 
 #include "schedule_wrapper.h"
 #include "lib.h"
 #include "process_control.h"
+#include "clocksource.h"
+#include "apic.h"
+#include "apic_wrapper.h"
+#include "vdso.h"
+#include "smp.h"
 
 extern node_block_t * node_list;
 extern void init_control_registers_paging(unsigned int * page);
 extern void set_control_registers_paging(unsigned int * page);
 extern void flush_tlb();
 
-void timer_handler();
+int timer_handler(int esp);
+static void idle_init();
+static int sched_top_level(cpu_t * cpu);
 
 int sanity_check;
+static uint32_t idle_stacks[IDLE_STACKS][IDLE_STACK_WORDS];	// Stacks for the idle context.
+static int idle_stack_index;	// Idle stack in use.
 int last_went[3];
-/*flag for rtc interrupt handler*/
 #define TRAP_GATE 0xF
 #define INTR_GATE 0xE
 
- int rtc_interrupt_flag[3];
-
 /*Local function declaration*/
 static int color_flag;
 idt_desc_t create_idt_entry(int seg_select, int dpl, int present);
@@ -115,7 +122,7 @@ void initialize_IDT()
 
     /*Create idt entry 14 for page faults*/
 	idt[0x0E] = create_idt_entry(KERNEL_CS, DPL_KERNEL, PRESENT_MASK);
-	SET_IDT_ENTRY(idt[0x0E], exception_page_fault);
+	SET_IDT_ENTRY(idt[0x0E], page_fault_wrapper);
 
     /*Create idt entry 15 for reserved*/
 	idt[0x0F] = create_idt_entry(KERNEL_CS, DPL_KERNEL, PRESENT_MASK);
@@ -202,6 +209,10 @@ void initialize_IDT()
 	//SET_IDT_ENTRY(idt[0x80], syscall_wrapper);
 	SET_IDT_ENTRY(idt[0x80], system_call);
 
+	/*Create idt entry 0xFF, for local APIC spurious interrupts*/
+	idt[SPURIOUS_VECTOR] = create_idt_entry(KERNEL_CS, DPL_KERNEL, PRESENT_MASK);
+	SET_IDT_ENTRY(idt[SPURIOUS_VECTOR], spurious_wrapper);
+
 	/*Load the IDT*/
 	lidt(idt_desc_ptr);
 
@@ -216,22 +227,56 @@ void initialize_IDT()
 	return;
 }
 
+/* void pit_arm(uint32_t count)
+ * Description: Starts PIT channel 0 on a one-shot count. It interrupts once
+ *              when the count runs out and then stays quiet until armed again.
+ * Inputs:      uint32_t count - PIT input clocks until the interrupt.
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  Replaces any count in progress.
+ */
+static void pit_arm(uint32_t count)
+{
+	outb(PIT_ONESHOT_CH0, COMMAND_REGISTER);
+	outb(count & 0xFF, CHANNEL_0_DATA_REGISTER);	//Sets the low byte
+	outb(count >> 8, CHANNEL_0_DATA_REGISTER);		// Sets the high byte
+}
+
+/* void timer_arm(uint32_t count)
+ * Description: Starts the tick timer on a one-shot count: the local APIC
+ *              timer once apic_irq_init has moved ticks over to it, the PIT
+ *              otherwise.
+ * Inputs:      uint32_t count - counts until the interrupt, from
+ *                               clock_timer_count.
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  Replaces any count in progress.
+ */
+static void timer_arm(uint32_t count)
+{
+	if (apic_irqs) {
+		lapic_timer_arm(count);
+	} else {
+		pit_arm(count);
+	}
+}
+
 /* void PIT_init()
  * Description: Enables IRQ0 interrupts to be sent from the
  * 							PIT chip.
  * Inputs:      NONE
  * Outputs:     NONE
  * Return Value: NONE
- * Side Effects:  Enables IRQ1 signal from the PIC and
- *								then initializes the PIT to run on 10ms intervals.
+ * Side Effects:  Enables IRQ1 signal from the PIC and arms the PIT for the
+ *								first tick. Ticks are timeslice_ms long (10ms by
+ *								default), but the timer only interrupts on the
+ *								ticks it needs, see timer_handler.
  */
 void PIT_init()
 {
 	int i = 0;
-	int divisor = 1193180/100;// 100; // Calculate our divisor; 100 corresponds to desired frequency in Hz
-	outb(0x36, COMMAND_REGISTER);					//Sets the command byte 0x36
-	outb(divisor & 0xFF, CHANNEL_0_DATA_REGISTER);				 //Sets the low byte
-	outb(divisor >> 8, CHANNEL_0_DATA_REGISTER);  // Sets the high byte
+	int j = 0;
+	pit_arm(pit_divisor);
 	timer_ticks = 0;
 	for (i = 0; i < 3; i++) {
 		schedule_info_arr[i].s_ebp = 0;
@@ -242,83 +287,441 @@ void PIT_init()
 	sanity_check = 0;
 	terminal_request = -1;
 	schedule_tick = 0;
+	for (i = 0; i < MAX_CPUS; i++) {
+		for (j = 0; j < SCHED_LEVELS; j++) {
+			run_queue_init(&cpus[i].run_queues[j], &cpus[i].sched_lock);
+		}
+	}
+	sched_reset_tick = 0;
+	timer_irqs = 0;
+	timer_wheel_init(tick_count);
+	idle_init();
 	enable_irq(IRQ0);
 
 	return;
 }
 
-/* void timer_handler()
- * Description: Is the PIT chip interrupt handler that handles scheduling.
- * 							Given the 10ms timeslice, the function will do a context switch
- *              when required.
+/* void idle_loop()
+ * Description: The idle context. Halts until an interrupt arrives, and hands
+ *              the CPU back as soon as a process is on the run queue.
  * Inputs:      NONE
  * Outputs:     NONE
+ * Return Value: Never returns.
+ * Side Effects:  NONE
+ */
+static void idle_loop()
+{
+	while (1) {
+		__asm__ volatile("hlt");
+		if (sched_top_level(this_cpu()) < SCHED_LEVELS) {
+			schedule_yield();
+		}
+	}
+}
+
+/* void build_kernel_context(uint32_t * stack_top, void (*entry)(), int * esp)
+ * Description: Builds a fresh ring 0 context at the top of a stack, laid out
+ *              the way schedule_wrapper leaves an interrupted context, so the
+ *              timer can switch to it like any other.
+ * Inputs:      uint32_t * stack_top - one past the highest word of the stack.
+ *              void (*entry)() - function the context starts in.
+ * Outputs:     int * esp - saved stack pointer of the context.
  * Return Value: NONE
- * Side Effects:  Saves context of current task and switches to next task
- *								in round robin interval.
+ * Side Effects:  Overwrites the top of the stack.
  */
-void timer_handler()
+void build_kernel_context(uint32_t * stack_top, void (*entry)(), int * esp)
 {
-	send_eoi(IRQ0);
-	cli();
+	uint32_t * frame = stack_top - CONTEXT_FRAME_WORDS;
+	int i;
 
-	flush_tlb();
+	// pushfl, then pushal (edi first), then the iret frame.
+	frame[0] = EFLAGS_RESERVED;
+	for (i = 1; i <= 8; i++) {
+		frame[i] = 0;
+	}
+	frame[9] = (uint32_t)entry;
+	frame[10] = KERNEL_CS;
+	frame[11] = EFLAGS_RESERVED | EFLAGS_IF;
 
+	*esp = (int)frame;
+}
 
-	if (schedule_top[current_process] != 0)
-	{
-		schedule_tss[current_process][schedule_top[current_process] - 1] = tss;
-		schedule_esp[current_process][schedule_top[current_process] - 1] = last_esp;
-		schedule_ebp[current_process][schedule_top[current_process] - 1] = last_ebp;
-		sanity_check = last_esp;
-	}
-
-	int next_process;
-	if (terminal_request == -1) {
-		// Increment current_process loop counter.
-		next_process = (current_process + 1) % NUM_TERMINALS;
-		while (schedule_top[next_process] == 0)  {
-			next_process = (next_process + 1) % NUM_TERMINALS;
+/* void idle_build_frame()
+ * Description: Builds a fresh idle context for the boot CPU at the top of
+ *              the current idle stack.
+ * Inputs:      NONE
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  Overwrites the saved idle context.
+ */
+static void idle_build_frame()
+{
+	build_kernel_context(&idle_stacks[idle_stack_index][IDLE_STACK_WORDS], idle_loop,
+		&cpus[0].idle_esp);
+}
+
+/* void idle_init()
+ * Description: Sets up the boot CPU's idle context and resets its idle
+ *              counters.
+ * Inputs:      NONE
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  NONE
+ */
+static void idle_init()
+{
+	idle_stack_index = 0;
+	idle_build_frame();
+	cpus[0].idle_running = 0;
+	cpus[0].idle_ticks = 0;
+	cpus[0].idle_cycles = 0;
+}
+
+/* void idle_abandon()
+ * Description: Called by execute. A keyboard interrupt that starts a shell
+ *              on a new terminal runs execute on whatever stack it
+ *              interrupted, and the new shell's parent frames stay there.
+ *              If that was the idle context, hand the stack over for good
+ *              and rebuild the idle context on the next idle stack. Only the
+ *              boot CPU takes keyboard interrupts, so only its idle context
+ *              is ever handed over.
+ * Inputs:      NONE
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  Stops the idle context. It is unavailable once every idle
+ *                stack has been given away.
+ */
+void idle_abandon()
+{
+	cpu_t * cpu = this_cpu();
+
+	if (!cpu->idle_running) {
+		return;
+	}
+	cpu->idle_running = 0;
+	cpu->idle_cycles += rdtsc() - cpu->idle_since;
+
+	if (idle_stack_index + 1 < IDLE_STACKS) {
+		idle_stack_index++;
+		idle_build_frame();
+	} else {
+		cpu->idle_esp = 0;
+	}
+}
+
+/* void sched_ap_start()
+ * Description: Brings an AP into the scheduler, once smp_sched_start lets
+ *              it in. Its local APIC timer is set up like the boot CPU's,
+ *              and the stack it booted on becomes its idle context.
+ *              Processes reach it through create_kernel_process_on, or
+ *              when it takes one off a busy CPU's run queue.
+ * Inputs:      NONE
+ * Outputs:     NONE
+ * Return Value: Never returns.
+ * Side Effects:  Enables interrupts on the AP.
+ */
+void sched_ap_start()
+{
+	cpu_t * cpu = this_cpu();
+
+	lapic_timer_init();
+	cpu->pid = SENTINEL_PROCESS;
+	cpu->process = 0;
+	cpu->video = (char *)VIDEO;
+	cpu->ticks_seen = tick_count;
+	cpu->idle_esp = 0;
+	cpu->idle_ticks = 0;
+	cpu->idle_cycles = 0;
+	cpu->idle_since = rdtsc();
+	cpu->idle_running = 1;
+
+	sti();
+	idle_loop();
+}
+
+/* int sched_top_level(cpu_t * cpu)
+ * Description: Finds the highest priority level with a process waiting.
+ * Inputs:      cpu_t * cpu - CPU whose run queues to look at.
+ * Outputs:     NONE
+ * Return Value: The level, or SCHED_LEVELS if every run queue is empty.
+ * Side Effects:  NONE
+ */
+static int sched_top_level(cpu_t * cpu)
+{
+	int level;
+	for (level = 0; level < SCHED_LEVELS; level++) {
+		if (cpu->run_queues[level].head != RUN_QUEUE_EMPTY) {
+			break;
 		}
-	} else if (terminal_request == 0) {
-		next_process = 0;
-	} else if (terminal_request == 1) {
-		next_process = 1;
-	} else if (terminal_request == 2) {
-		next_process = 2;
 	}
+	return level;
+}
 
-	current_process = next_process;
-	terminal_request = -1;
+/* void sched_reset_levels()
+ * Description: Moves every process back to level 0 with a fresh slice, so
+ *              CPU-bound processes demoted to the bottom are not starved by
+ *              a steady stream of interactive ones.
+ * Inputs:      NONE
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  Requeues every waiting process at level 0 of its CPU,
+ *                oldest first.
+ */
+static void sched_reset_levels()
+{
+	int level;
+	int pid;
+	int i;
+
+	for (i = 0; i < cpus_online; i++) {
+		for (level = 1; level < SCHED_LEVELS; level++) {
+			while ((pid = run_queue_pop(&cpus[i].run_queues[level])) != RUN_QUEUE_EMPTY) {
+				run_queue_push(&cpus[i].run_queues[0], pid);
+			}
+		}
+	}
+	for (pid = 0; pid < TOTAL_PROCESSES; pid++) {
+		control_blocks[pid].level = 0;
+		control_blocks[pid].slice_left = SCHED_BASE_SLICE;
+	}
+	sched_reset_tick = tick_count;
+}
+
+/* int sched_steal(cpu_t * cpu)
+ * Description: Takes a process that another CPU has waiting, for a CPU
+ *              that has nothing of its own to run. Only a process switched
+ *              out without the kernel lock can move: its context is a user
+ *              mode one, or kernel code that gave the lock up and keeps no
+ *              per-CPU state.
+ * Inputs:      cpu_t * cpu - the CPU looking for work.
+ * Outputs:     NONE
+ * Return Value: The process ID, off its run queue, or RUN_QUEUE_EMPTY.
+ * Side Effects:  NONE
+ */
+static int sched_steal(cpu_t * cpu)
+{
+	int level;
+	int pid;
+	int i;
+
+	if (cpu - cpus >= sched_cpus) {
+		return RUN_QUEUE_EMPTY;
+	}
+	for (level = 0; level < SCHED_LEVELS; level++) {
+		for (i = 0; i < cpus_online; i++) {
+			if (&cpus[i] == cpu) {
+				continue;
+			}
+			pid = run_queue_movable(&cpus[i].run_queues[level]);
+			if (pid != RUN_QUEUE_EMPTY) {
+				run_queue_remove(&cpus[i].run_queues[level], pid);
+				return pid;
+			}
+		}
+	}
+	return RUN_QUEUE_EMPTY;
+}
+
+/* void sched_balance(cpu_t * cpu)
+ * Description: Wakes an idle CPU when this one has a process waiting that
+ *              could move. The idle CPU takes it in sched_steal.
+ * Inputs:      cpu_t * cpu - the CPU with the waiting processes.
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  NONE
+ */
+static void sched_balance(cpu_t * cpu)
+{
+	int level;
+	int i;
+
+	for (level = 0; level < SCHED_LEVELS; level++) {
+		if (run_queue_movable(&cpu->run_queues[level]) != RUN_QUEUE_EMPTY) {
+			break;
+		}
+	}
+	if (level == SCHED_LEVELS) {
+		return;
+	}
+	for (i = 0; i < sched_cpus; i++) {
+		if (&cpus[i] != cpu && cpus[i].idle_running) {
+			schedule_kick_cpu(i);
+			return;
+		}
+	}
+}
+
+/* int timer_handler(int esp)
+ * Description: Is the tick timer's interrupt handler, the PIT's or the
+ *              local APIC timer's, that handles scheduling. Every CPU runs
+ *              it on its own timer and schedules its own run queues.
+ *              Processes are scheduled with a multi-level feedback queue:
+ *              one that uses up its slice drops a level, where slices are
+ *              twice as long, and one woken from a wait queue goes back to
+ *              level 0. A process keeps the CPU until its slice runs out, it
+ *              blocks, or a process at a higher level is waiting. A CPU
+ *              with nothing of its own to run takes a movable process off
+ *              another's run queue.
+ *              The timer runs one-shot: it is armed for the end of the running
+ *              process's slice or, on the boot CPU, the next timer on the
+ *              wheel, and left off while idle with no timers, so the timer
+ *              does not interrupt on ticks where nothing would change.
+ *              Elapsed ticks are read off the TSC instead.
+ * Inputs:      int esp - stack pointer of the interrupted context, as
+ *                        schedule_wrapper saved it.
+ * Outputs:     NONE
+ * Return Value: Stack pointer of the context to resume.
+ * Side Effects:  Saves context of current task and switches to the next
+ *                one when required. Takes the kernel lock, and leaves it
+ *                held only if the resumed context held it.
+ */
+int timer_handler(int esp)
+{
+	uint32_t start_cycles = rdtsc();
+	cpu_t * cpu = this_cpu();
+	int index = cpu - cpus;
+	int previous_pid = cpu->pid;
+	int yielded = cpu->yield_request;
+	int next_pid = RUN_QUEUE_EMPTY;
+	int requested = RUN_QUEUE_EMPTY;
+	int keep = 0;
+	int locked;
+	int expired;
+	uint32_t ticks;
+	uint32_t ahead;
+	uint32_t deadline;
+	pcb_t * pcb = &control_blocks[previous_pid];
+	cpu->yield_request = 0;
+	cpu->kicked = 0;
+	if (!yielded) {
+		send_eoi(IRQ0);
+	}
+	cli();
+
+	// The interrupted context held the kernel lock if this CPU already had it.
+	locked = !lock_kernel();
+
+	// Charge the ticks since this CPU last looked to whoever was running.
+	// Time spent on the run queue is added to ready_ticks when a process
+	// leaves it.
+	tick_count += clock_take_ticks();
+	ticks = tick_count - cpu->ticks_seen;
+	cpu->ticks_seen = tick_count;
+	if (ticks != 0) {
+		if (cpu->idle_running) {
+			cpu->idle_ticks += ticks;
+		} else {
+			pcb->run_ticks += ticks;
+			pcb->ready_ticks += ticks;
+			pcb->slice_left -= ticks;
+		}
+		if (tick_count - sched_reset_tick >= SCHED_RESET_TICKS) {
+			sched_reset_levels();
+		}
+	}
+
+	// Fire the timers that are due, waking their sleepers before the
+	// scheduling decision below.
+	timer_wheel_run(tick_count);
+
+	// A terminal switch asks for the new terminal's foreground process to
+	// go first, if it can run here.
+	if (terminal_request != -1) {
+		if (schedule_top[terminal_request] != 0) {
+			requested = schedule_stack[terminal_request][schedule_top[terminal_request] - 1];
+			if (!control_blocks[requested].on_run_queue ||
+				(control_blocks[requested].cpu != index && control_blocks[requested].sched_locked)) {
+				requested = RUN_QUEUE_EMPTY;
+			}
+		}
+		terminal_request = -1;
+	}
 
-	if (schedule_top[current_process] != 0)
+	// Save the interrupted context, the idle loop's or the current process's.
+	// A process that is not blocked either keeps the CPU or goes to the back
+	// of its level's queue. A kernel process that has exited is dropped.
+	if (cpu->idle_running) {
+		cpu->idle_esp = esp;
+	} else if (pcb->pid != -1)
 	{
-		if (schedule_ebp[current_process][schedule_top[current_process] - 1] != 0)
-		{
-			current_pid = schedule_stack[current_process][schedule_top[current_process] - 1];
-			last_esp = schedule_esp[current_process][schedule_top[current_process] - 1];
-			last_ebp = schedule_ebp[current_process][schedule_top[current_process] - 1];
-			tss = schedule_tss[current_process][schedule_top[current_process] - 1];
-
-	        process_pages[VIRTUAL_PROGRAM] = (M_4 * (current_pid + 1)) | PAGE_ARGS;
-
-			if (current_process != current_terminal) {
-				process_tables[VID_IDX] = (VIDEO_1 + (0x1000 * current_process)) | USER_MASK | READWRITE_MASK | PRESENT_MASK;
-				video_mem = (int8_t *)(VIDEO_1 + (0x1000 * current_process));
+		pcb->sched_esp = esp;
+		pcb->sched_locked = locked;
+		sanity_check = esp;
+		if (!pcb->blocked) {
+			expired = pcb->slice_left <= 0;
+			if (expired) {
+				if (pcb->level < SCHED_LEVELS - 1) {
+					pcb->level++;
+				}
+				pcb->slice_left = SCHED_BASE_SLICE << pcb->level;
+			}
+
+			keep = !yielded && !expired && requested == RUN_QUEUE_EMPTY &&
+				sched_top_level(cpu) >= pcb->level;
+			if (!keep) {
+				schedule_enqueue(previous_pid);
+			}
+		}
+	}
+
+	if (!keep) {
+		if (requested != RUN_QUEUE_EMPTY) {
+			run_queue_remove(&cpus[control_blocks[requested].cpu].run_queues[control_blocks[requested].level],
+				requested);
+			next_pid = requested;
+		} else {
+			next_pid = sched_top_level(cpu);
+			if (next_pid < SCHED_LEVELS) {
+				next_pid = run_queue_pop(&cpu->run_queues[next_pid]);
 			} else {
-				process_tables[VID_IDX] = VIDEO | USER_MASK | READWRITE_MASK | PRESENT_MASK;
-				video_mem = (int8_t *)VIDMAP;
+				next_pid = sched_steal(cpu);
 			}
+		}
+	}
+
+	if (next_pid != RUN_QUEUE_EMPTY)
+	{
+		if (cpu->idle_running) {
+			cpu->idle_running = 0;
+			cpu->idle_cycles += rdtsc() - cpu->idle_since;
+		}
+
+		pcb = &control_blocks[next_pid];
+		pcb->cpu = index;
+		cpu->pid = next_pid;
+		cpu->process = pcb->terminal;
+		esp = pcb->sched_esp;
+		locked = pcb->sched_locked;
+
+		// The process's own page directory already maps its program,
+		// VIDMAP and mmap pages, so switching is a CR3 load.
+		if (next_pid != previous_pid) {
+			load_page_directory(next_pid);
+		}
 
-			int addr = (int)&process_tables[VID_IDX];
-			process_pages[VID_IDX] = ((addr >> 12) << 12) | 0x7;
+		if (cpu->process != current_terminal) {
+			cpu->video = (int8_t *)(VIDEO_1 + (0x1000 * cpu->process));
+		} else {
+			cpu->video = (int8_t *)VIDMAP;
+		}
 
-			flush_tlb();
+		cpu->tss.esp0 = KERNEL_ADDR + (M_4 - 0xF) - (2 * K_4 * next_pid);
 
-			tss.esp0 = KERNEL_ADDR + (M_4 - 0xF) - (2 * K_4 * current_pid);
+		switch_cycles += rdtsc() - start_cycles;
+		switch_count++;
+	} else if (!keep && cpu->idle_esp != 0) {
+		// Nothing can run: halt in the idle loop until an interrupt wakes a
+		// process. Without an idle stack the interrupted context carries on.
+		if (!cpu->idle_running) {
+			cpu->idle_running = 1;
+			cpu->idle_since = rdtsc();
 		}
+		esp = cpu->idle_esp;
+		locked = 0;
 	}
 
+	// Let processes read the new tick count and run times without a trap.
+	vdso_update();
 
 	if (schedule_tick == 0) {
 		schedule_tick = 1;
@@ -326,42 +729,177 @@ void timer_handler()
 		schedule_tick = 0;
 	}
 
-	return;
+	// Arm the next interrupt for the end of the running process's slice or
+	// the next timer on the wheel, whichever comes first, as far as a
+	// one-shot count reaches. Idle with no timers needs no interrupt at all.
+	// The wheel is left to the boot CPU.
+	ahead = 0;
+	if (!cpu->idle_running) {
+		ahead = control_blocks[cpu->pid].slice_left;
+		if ((int)ahead < 1) {
+			ahead = 1;
+		}
+	}
+	if (index == 0 && timer_next_deadline(&deadline)) {
+		deadline = ((int32_t)(deadline - tick_count) < 1) ? 1 : deadline - tick_count;
+		if (ahead == 0 || deadline < ahead) {
+			ahead = deadline;
+		}
+	}
+	if (ahead != 0) {
+		if (ahead > timer_max_count / timer_divisor) {
+			ahead = timer_max_count / timer_divisor;
+		}
+		timer_arm(clock_timer_count(ahead));
+	}
+
+	// Hand what this CPU cannot get to soon to an idle one.
+	sched_balance(cpu);
+
+	if (!yielded) {
+		tick_cycles += rdtsc() - start_cycles;
+		timer_irqs++;
+	}
+
+	unlock_kernel(!locked);
+	return esp;
+}
+
+/* void schedule_yield()
+ * Description: Gives up the rest of the current time slice by running the
+ *              scheduler through the timer's vector, without a PIT tick.
+ * Inputs:      NONE
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  Returns once the current process is scheduled again.
+ */
+void schedule_yield()
+{
+	int flags = 0;
+	cli_and_save(flags);
+	this_cpu()->yield_request = 1;
+	__asm__ volatile("int $0x20");
+	restore_flags(flags);
+}
+
+/* void schedule_wake(int pid)
+ * Description: Boosts a process that has just been woken to level 0, as it
+ *              was waiting on input or a timer, and puts it back on its
+ *              CPU's run queue. A process that still has its CPU, because it
+ *              blocked and could not be switched out yet, is left to the
+ *              next tick.
+ * Inputs:      int pid - the woken process.
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  Called with interrupts off.
+ */
+void schedule_wake(int pid)
+{
+	pcb_t * pcb = &control_blocks[pid];
+	cpu_t * cpu = &cpus[pcb->cpu];
+
+	pcb->level = 0;
+	pcb->slice_left = SCHED_BASE_SLICE;
+	if (pid == cpu->pid && !cpu->idle_running) {
+		return;
+	}
+	if (pcb->sched_esp != 0) {
+		schedule_enqueue(pid);
+		// Preempt a lower level process now rather than at the end of its
+		// slice. Another CPU is interrupted for it, even from idle.
+		if (cpu == this_cpu()) {
+			if (!cpu->idle_running && control_blocks[cpu->pid].level > 0) {
+				schedule_kick();
+			}
+		} else if (cpu->idle_running || control_blocks[cpu->pid].level > 0) {
+			schedule_kick_cpu(pcb->cpu);
+		} else {
+			sched_balance(cpu);
+		}
+	}
+}
+
+/* void schedule_kick()
+ * Description: Makes the timer interrupt right away, for scheduling
+ *              decisions that cannot wait for the next armed tick.
+ * Inputs:      NONE
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  Rearms this CPU's tick timer.
+ */
+void schedule_kick()
+{
+	timer_arm(1);
+}
+
+/* void schedule_kick_cpu(int index)
+ * Description: Makes a CPU run its scheduler right away: this one through
+ *              its timer, another with an IPI on the timer's vector. An
+ *              IPI the other CPU has not taken yet is enough.
+ * Inputs:      int index - cpus index of the CPU.
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  NONE
+ */
+void schedule_kick_cpu(int index)
+{
+	if (&cpus[index] == this_cpu()) {
+		schedule_kick();
+	} else if (!cpus[index].kicked) {
+		cpus[index].kicked = 1;
+		lapic_send_ipi(cpus[index].apic_id, IRQ_VECTOR_BASE);
+	}
+}
+
+/* void schedule_enqueue(int pid)
+ * Description: Puts a process with a saved context on the run queue of
+ *              its priority level, on the CPU it last ran on.
+ * Inputs:      int pid - the process to queue.
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  Called with interrupts off.
+ */
+void schedule_enqueue(int pid)
+{
+	pcb_t * pcb = &control_blocks[pid];
+
+	run_queue_push(&cpus[pcb->cpu].run_queues[pcb->level], pid);
 }
 
 /* void RTC_init()
- * Description: Enables IRQ8 interrupts to be sent from the
- * 							RTC chip. Then unmasks the IRQ2 and IRQ8,
- *							to receive the interrupts through the PIC
- *							key to the screen.
+ * Description: Sets the RTC chip to its fixed rate, RTC_HW_RATE, with the
+ *							periodic interrupt left off until an rtc file is
+ *							opened. Unmasks IRQ2 so IRQ8 can reach the master
+ *							PIC once it is enabled.
  * Inputs:      NONE
  * Outputs:     NONE
  * Return Value: NONE
- * Side Effects:  Enables IRQ8 signal from the PIC and
- *								then unmasks the IRQ2 and IRQ8 on the PIC.
+ * Side Effects:  Unmasks IRQ2 on the PIC.
  */
 void RTC_init()
 {
-	outb(0x8B, CMOS_REG);					//selects reg B, and disables NMIs
 	char prev;
+	int flags = 0;
+
+	cli_and_save(flags);
+	outb(RTC_REG_B, CMOS_REG);				//selects reg B, and disables NMIs
 	prev = inb(RTC_REG);
-	outb(0x8B, CMOS_REG);				 //set the index again to reg B
-	outb(prev | 0x40, RTC_REG);  //enable IRQ8 interrupt flag
-  int flags = 0;
+	outb(RTC_REG_B, CMOS_REG);				//set the index again to reg B
+	outb(prev & ~RTC_PIE, RTC_REG);		//periodic interrupt off
+	outb(RTC_REG_A, CMOS_REG);				//selects reg A
+	prev = inb(RTC_REG);
+	outb(RTC_REG_A, CMOS_REG);
+	outb((prev & 0xF0) | RTC_HW_RATE_BITS, RTC_REG);
+
 	enable_irq(IRQ2);
-	enable_irq(IRQ8);
 	rtc_optable();
-	rtc_running[0] = 2;
-	rtc_running[1] = 2;
-	rtc_running[2] = 2;
-  rtc_virtual_interupt[0] = 0;
-  rtc_virtual_interupt[1] = 0;
-  rtc_virtual_interupt[2] = 0;
-
-  // Need to enable interrupts
-  restore_flags(flags);
+	rtc_irqs = 0;
+	rtc_wake_at = RTC_WAKE_NEVER;
+	rtc_open_count = 0;
+	wait_queue_init(&rtc_wait_queue);
+	wait_queue_init(&poll_wait_queue);
 
-	return;
+	restore_flags(flags);
 }
 
 /* void keyboard_init()
@@ -394,21 +932,41 @@ void paging_init()
 		/*page_directory[i]*/process_pages/*[0]*/[i] = 0x00000002;
 	}
 
-	/*intializes first table in mem*/
+	/*intializes first table in mem, shared by every page directory*/
 	for (i = 0; i < PAGE_SIZE; i++)
 	{
-		/*first_table[i]*/process_pages/*[0]*/[i] =  0x00000002;
+		/*first_table[i]*/process_tables/*[0]*/[i] =  0x00000002;
+	}
+
+	/*maps the kernel, sets it to present and global. Global TLB entries are
+	 * shared by every page directory, so this matches the processes' entry*/
+	process_pages/*[0]*/[1] = KERNEL_USER | GLOBAL_MASK;
+
+	/*maps video memory and the terminals' backing pages, sets them to present and global*/
+	process_tables/*[0]*/[VIDEOMEM] = VIDEO | GLOBAL_MASK | READWRITE_MASK | PRESENT_MASK;
+	for (i = 0; i < NUM_TERMINALS; i++)
+	{
+		process_tables[VIDEOMEM + 1 + i] = (VIDEO_1 + (0x1000 * i)) | GLOBAL_MASK | USER_MASK | READWRITE_MASK | PRESENT_MASK;
 	}
 
-	/*maps the kernel, sets it to present*/
-	process_pages/*[0]*/[1] = KERNEL;
+	/*sets up first table in the directory, with the same bits as the processes'
+	 * so the global video entries are cached the same way everywhere*/
+  	process_pages/*[0]*/[0] = ((unsigned int)process_tables/*[0]*/)| USER_MASK | PRESENT_MASK | READWRITE_MASK;
 
-	/*maps video memory, sets it to present*/
-	process_tables/*[0]*/[VIDEOMEM] = VIDEO  | PRESENT_MASK;
+	/*maps VIDMAP through the first terminal's table for the kernel's own prints*/
+	for (i = 0; i < NUM_TERMINALS * PAGE_SIZE; i++)
+	{
+		vidmap_tables[i / PAGE_SIZE][i % PAGE_SIZE] = 0x00000002;
+	}
 
-	/*sets up first table in the directory*/
-  	process_pages/*[0]*/[0] = ((unsigned int)process_tables/*[0]*/)| PRESENT_MASK | READWRITE_MASK;
+	/*maps the read-only kernel data page after VIDMAP in every terminal's table*/
+	for (i = 0; i < NUM_TERMINALS; i++)
+	{
+		vdso_map(vidmap_tables[i]);
+	}
+	process_pages/*[0]*/[VID_IDX] = ((unsigned int)vidmap_tables[0]) | USER_MASK | READWRITE_MASK | PRESENT_MASK;
 	init_control_registers_paging(process_pages/*[0]*/);
+	set_vidmap_terminal(0);
 
 	return;
 }
@@ -456,8 +1014,11 @@ idt_desc_t create_idt_entry(int seg_select, int dpl, int present)
 void handle_keyboard()
 {
 	int flags = 0;
+	int locked;
 
 	cli_and_save(flags);
+	locked = lock_kernel();
+	keyboard_irq_tsc = rdtsc();
 
 	char * video_past = video_mem;
 	video_mem = (int8_t *)VIDEO;
@@ -470,14 +1031,16 @@ void handle_keyboard()
 	video_mem = video_past;
 
 	send_eoi(IRQ1);
+	unlock_kernel(locked);
 	restore_flags(flags);
 	return;
 }
 
 /*
  * handle_RTC
- *   DESCRIPTION: Handles the RTC interrupt by flashing the screen red
- *                and sends the eoi
+ *   DESCRIPTION: Handles the RTC interrupt. Counts it, and wakes the readers
+ *                in rtc_read and poll once the earliest of them is due. The readers
+ *                that are not due yet go back to sleep. Sends the eoi
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
@@ -487,19 +1050,31 @@ void handle_RTC()
 {
     /*Local var to save flags*/
 	int flags = 0;
+	int wake;
+	int locked;
     //Mask interrupts and save flags
 	cli_and_save(flags);
-  rtc_virtual_interupt[0] = rtc_virtual_interupt[0] + 1;
-  rtc_virtual_interupt[1] = rtc_virtual_interupt[1] + 1;
-  rtc_virtual_interupt[2] = rtc_virtual_interupt[2] + 1;
+	locked = lock_kernel();
+	spin_lock(&rtc_lock);
+	rtc_irqs++;
+	wake = (int32_t)(rtc_irqs - rtc_wake_at) >= 0;
+	if (wake) {
+		rtc_wake_at = rtc_irqs + RTC_WAKE_NEVER;
+	}
+	spin_unlock(&rtc_lock);
+	if (wake) {
+		wait_queue_wake(&rtc_wait_queue);
+		wait_queue_wake(&poll_wait_queue);
+	}
 
     /*Send eoi to interrupt port 8*/
 
 	send_eoi(IRQ8);
-	outb(0x0C, CMOS_REG);
+	outb(RTC_REG_C, CMOS_REG);
 	inb(RTC_REG);
 
     //UnMask interrupts and restore flags
+	unlock_kernel(locked);
 	restore_flags(flags);
 	return;
 }
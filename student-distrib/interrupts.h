@@ -10,6 +10,8 @@
 #include "types.h"
 #include "syscalls.h"
 #include "filesystem_driver.h"
+#include "wait_queue.h"
+#include "lock.h"
 
 #define DPL_KERNEL 	0
 #define DPL_USER 	3
@@ -29,6 +31,7 @@
 #define PRESENT_MASK    0x00000001
 #define READWRITE_MASK  0x00000002
 #define USER_MASK		0x00000004
+#define GLOBAL_MASK		0x00000100	// Same in every page directory, survives CR3 loads.
 
 extern void handle_RTC();
 
@@ -39,10 +42,21 @@ extern void PIT_init();
 extern void RTC_init();
 extern void paging_init();
 extern void keyboard_init();
-
-extern  int rtc_interrupt_flag[3];
-int rtc_running[3];
-int rtc_virtual_interupt[3];
+extern void schedule_yield();
+extern void schedule_wake(int pid);
+extern void schedule_enqueue(int pid);
+extern void schedule_kick();
+extern void schedule_kick_cpu(int index);
+extern void idle_abandon();
+extern void build_kernel_context(uint32_t * stack_top, void (*entry)(), int * esp);
+extern void sched_ap_start();
+
+uint32_t rtc_irqs;				// Hardware RTC interrupts since boot.
+uint32_t rtc_wake_at;			// rtc_irqs value the next waiting reader is due at.
+int rtc_open_count;				// Open rtc files. The RTC is stopped at zero.
+spinlock_t rtc_lock;			// Protects the rtc globals and the rtc files' dividers.
+wait_queue_t rtc_wait_queue;	// Processes waiting in rtc_read for their next virtual interrupt.
+wait_queue_t poll_wait_queue;	// Processes in poll, woken whenever a file may have become ready.
 
 // extern int process_video_mem[3];
 
@@ -67,6 +81,14 @@ int rtc_virtual_interupt[3];
 #define IRQ6    0x06
 #define IRQ7    0x07
 #define IRQ8    0x08
+
+#define IDLE_STACK_WORDS	1024	// Words in the idle context's stack.
+#define IDLE_STACKS			3		// One per terminal whose first shell can start from idle.
+#define SCHED_BASE_SLICE	1		// Ticks in a level 0 slice. Each level down doubles it.
+#define SCHED_RESET_TICKS	100		// Ticks between moving every process back to level 0.
+#define CONTEXT_FRAME_WORDS	12		// pushfl, pushal and an iret frame without a stack switch.
+#define EFLAGS_RESERVED		0x002	// EFLAGS bit 1, always set.
+#define EFLAGS_IF			0x200	// EFLAGS interrupt enable.
 #define PS2PORT 0x60
 
 #define NUM_COLS        80
@@ -85,11 +107,16 @@ schedule_info schedule_info_arr[3];
 volatile int terminal_request;
 volatile int schedule_tick;
 
-int timer_ticks;
-int current_process;
-int last_esp;
+uint32_t sched_reset_tick;	// Tick of the last move back to level 0.
+uint32_t keyboard_irq_tsc;	// TSC when the last keyboard interrupt arrived.
 
-int last_ebp;
+int timer_ticks;
 int strand_type_lock;
 
+uint32_t switch_cycles;	// Cycles spent switching processes in timer_handler.
+uint32_t switch_count;	// Process switches counted in switch_cycles.
+uint32_t tick_cycles;	// Cycles spent in timer_handler on timer interrupts.
+volatile uint32_t tick_count;	// Timer ticks since boot, whether or not each one interrupted.
+volatile uint32_t timer_irqs;	// Timer interrupts counted in tick_cycles.
+
 #endif
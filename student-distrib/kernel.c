@@ -11,6 +11,10 @@
 #include "interrupts.h"
 #include "filesystem_driver.h"
 #include "process_control.h"
+#include "frame_allocator.h"
+#include "clocksource.h"
+#include "smp.h"
+#include "apic.h"
 
 // #define RUN_TESTS
 
@@ -18,6 +22,30 @@
 /* Check if the bit BIT in FLAGS is set. */
 #define CHECK_FLAG(flags, bit)   ((flags) & (1 << (bit)))
 
+/* Reads the number given to a KEY=value option in the boot command line,
+   or returns 0 if the option is missing. */
+static uint32_t cmdline_option(const char * cmdline, const char * key) {
+    uint32_t len = strlen(key);
+    uint32_t value = 0;
+
+    while (*cmdline != '\0') {
+        if (strncmp(cmdline, key, len) == 0) {
+            cmdline += len;
+            while (*cmdline >= '0' && *cmdline <= '9') {
+                value = value * 10 + (*cmdline - '0');
+                cmdline++;
+            }
+            return value;
+        }
+        /* Skip to the start of the next option. */
+        while (*cmdline != '\0' && *cmdline != ' ')
+            cmdline++;
+        while (*cmdline == ' ')
+            cmdline++;
+    }
+    return 0;
+}
+
 /* Check if MAGIC is valid and print the Multiboot information structure
    pointed by ADDR. */
 void entry(unsigned long magic, unsigned long addr) {
@@ -26,6 +54,9 @@ void entry(unsigned long magic, unsigned long addr) {
     /* Clear the screen. */
     clear();
 
+    /* No frames are free until the memory map says where RAM is. */
+    frames_init();
+
     /* Am I booted by a Multiboot-compliant boot loader? */
     if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
         printf("Invalid magic number: 0x%#x\n", (unsigned)magic);
@@ -38,17 +69,25 @@ void entry(unsigned long magic, unsigned long addr) {
     /* Print out the flags. */
     printf("flags = 0x%#x\n", (unsigned)mbi->flags);
 
-    /* Are mem_* valid? */
-    if (CHECK_FLAG(mbi->flags, 0))
+    /* Are mem_* valid? Upper memory starts at 1MB; only used without a memory map. */
+    if (CHECK_FLAG(mbi->flags, 0)) {
         printf("mem_lower = %uKB, mem_upper = %uKB\n", (unsigned)mbi->mem_lower, (unsigned)mbi->mem_upper);
+        if (!CHECK_FLAG(mbi->flags, 6))
+            frames_add_region(0x100000, (uint32_t)mbi->mem_upper * 1024);
+    }
 
     /* Is boot_device valid? */
     if (CHECK_FLAG(mbi->flags, 1))
         printf("boot_device = 0x%#x\n", (unsigned)mbi->boot_device);
 
     /* Is the command line passed? */
-    if (CHECK_FLAG(mbi->flags, 2))
+    if (CHECK_FLAG(mbi->flags, 2)) {
         printf("cmdline = %s\n", (char *)mbi->cmdline);
+        /* timeslice=<ms> sets the timer period. */
+        timeslice_ms = cmdline_option((char *)mbi->cmdline, "timeslice=");
+        /* pic=1 keeps interrupts on the 8259s and the PIT. */
+        pic_option = cmdline_option((char *)mbi->cmdline, "pic=");
+    }
 
     /*file system adress at mod_start
     we use system calls too change the state of the file system
@@ -95,7 +134,7 @@ void entry(unsigned long magic, unsigned long addr) {
                 (unsigned)mbi->mmap_addr, (unsigned)mbi->mmap_length);
         for (mmap = (memory_map_t *)mbi->mmap_addr;
                 (unsigned long)mmap < mbi->mmap_addr + mbi->mmap_length;
-                mmap = (memory_map_t *)((unsigned long)mmap + mmap->size + sizeof (mmap->size)))
+                mmap = (memory_map_t *)((unsigned long)mmap + mmap->size + sizeof (mmap->size))) {
             printf("    size = 0x%x, base_addr = 0x%#x%#x\n    type = 0x%x,  length    = 0x%#x%#x\n",
                     (unsigned)mmap->size,
                     (unsigned)mmap->base_addr_high,
@@ -103,8 +142,25 @@ void entry(unsigned long magic, unsigned long addr) {
                     (unsigned)mmap->type,
                     (unsigned)mmap->length_high,
                     (unsigned)mmap->length_low);
+            /* Type 1 is available RAM; anything past 4GB is out of reach. */
+            if (mmap->type == 1 && mmap->base_addr_high == 0)
+                frames_add_region(mmap->base_addr_low,
+                        mmap->length_high ? FRAME_LIMIT : mmap->length_low);
+        }
     }
 
+    /* Keep the boot modules (the file system) out of the frame allocator. */
+    if (CHECK_FLAG(mbi->flags, 3)) {
+        int mod_count = 0;
+        module_t* mod = (module_t*)mbi->mods_addr;
+        while (mod_count < mbi->mods_count) {
+            frames_reserve(mod->mod_start, mod->mod_end);
+            mod_count++;
+            mod++;
+        }
+    }
+    printf("%u of %u page frames free\n", free_frames, total_frames);
+
     /* Construct an LDT entry in the GDT */
     {
         seg_desc_t the_ldt_desc;
@@ -122,33 +178,19 @@ void entry(unsigned long magic, unsigned long addr) {
         lldt(KERNEL_LDT);
     }
 
-    /* Construct a TSS entry in the GDT */
-    {
-        seg_desc_t the_tss_desc;
-        the_tss_desc.granularity   = 0x0;
-        the_tss_desc.opsize        = 0x0;
-        the_tss_desc.reserved      = 0x0;
-        the_tss_desc.avail         = 0x0;
-        the_tss_desc.seg_lim_19_16 = TSS_SIZE & 0x000F0000;
-        the_tss_desc.present       = 0x1;
-        the_tss_desc.dpl           = 0x0;
-        the_tss_desc.sys           = 0x0;
-        the_tss_desc.type          = 0x9;
-        the_tss_desc.seg_lim_15_00 = TSS_SIZE & 0x0000FFFF;
-
-        SET_TSS_PARAMS(the_tss_desc, &tss, tss_size);
-
-        tss_desc_ptr = the_tss_desc;
-
-        tss.ldt_segment_selector = KERNEL_LDT;
-        tss.ss0 = KERNEL_DS;
-        tss.esp0 = 0x800000;
-        ltr(KERNEL_TSS);
-    }
+    /* This CPU's TSS; the other CPUs load theirs as they start. */
+    tss_init(0);
 
 		// init and load the IDT
 	  initialize_IDT();
 
+    /* Fast system calls, next to int $0x80. */
+    sysenter_init();
+
+
+    /* Time the TSC against the PIT before it starts ticking. */
+    clocksource_init();
+    printf("TSC: %u kHz, timer tick: %u ns\n", tsc_khz, tick_period_ns);
 
     PIT_init();
     // Keyboard
@@ -160,10 +202,23 @@ void entry(unsigned long magic, unsigned long addr) {
     // Initialize paging.
     paging_init();
 
+    /* Start the other processors, if the MADT lists any. */
+    smp_init();
+    printf("CPUs: %d of %d online\n", cpus_online, num_cpus);
+
+    /* Route IRQs through the IOAPIC and tick off the local APIC timer. */
+    apic_irq_init();
+    printf("Interrupts: %s\n", apic_irqs ? "IOAPIC, local APIC timer" : "8259, PIT");
+
     process_control_block_init();
 
     first_process_init();
 
+    /* From here on the kernel runs under the big kernel lock, with every
+     * online CPU scheduling processes. */
+    lock_kernel();
+    smp_sched_start();
+
     uint8_t * p;
     terminal_open(p);
 
@@ -10,8 +10,6 @@
 #define SUCCESS 0
 #define FAILURE -1
 
-char* video_mem;
-
 
 int32_t printf(int8_t *format, ...);
 void putc(uint8_t c);
@@ -92,6 +90,56 @@ static inline uint32_t inl(port) {
     return val;
 }
 
+/* Reads the low 32 bits of the time stamp counter. This wraps every
+ * second or so, so it is only good for timing short intervals */
+static inline uint32_t rdtsc(void) {
+    uint32_t val;
+    asm volatile ("rdtsc"
+            : "=a"(val)
+            :
+            : "edx"
+    );
+    return val;
+}
+
+/* Reads the whole 64-bit time stamp counter */
+static inline uint64_t rdtsc64(void) {
+    uint64_t val;
+    asm volatile ("rdtsc"
+            : "=A"(val)
+    );
+    return val;
+}
+
+/* Runs CPUID for a leaf and returns EDX, which holds most feature flags */
+static inline uint32_t cpuid_edx(uint32_t leaf) {
+    uint32_t eax = leaf;
+    uint32_t edx;
+    asm volatile ("cpuid"
+            : "+a"(eax), "=d"(edx)
+            :
+            : "ebx", "ecx"
+    );
+    return edx;
+}
+
+/* Writes a model specific register */
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    asm volatile ("wrmsr"
+            :
+            : "c"(msr), "A"(val)
+    );
+}
+
+/* Drops the TLB entry for the page holding the given virtual address */
+static inline void invlpg(uint32_t addr) {
+    asm volatile ("invlpg (%0)"
+            :
+            : "r"(addr)
+            : "memory"
+    );
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
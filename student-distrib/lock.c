@@ -0,0 +1,230 @@
+/* lock.c - The big kernel lock, sleeping mutexes and interrupts-off tracking.
+ * vim:ts=4 noexpandtab
+ */
+#include "lock.h"
+#include "process_control.h"
+
+// Call site and TSC of the irq_save that turned interrupts off.
+static const char * irqoff_file;
+static int irqoff_line;
+static uint32_t irqoff_since;
+
+/*
+ * lock_kernel()
+ *   DESCRIPTION: Takes the big kernel lock, unless this CPU holds it
+ *                already. Each entry into the kernel passes the result to
+ *                unlock_kernel on its way out, so only the outermost entry
+ *                on a CPU releases it.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if it was taken here, 0 if this CPU already held it.
+ *   SIDE EFFECTS: Spins with interrupts off while another CPU holds it.
+ */
+int lock_kernel()
+{
+    cpu_t * cpu;
+    int flags = 0;
+
+    irq_save(flags);
+    cpu = this_cpu();
+    if (kernel_lock_owner == cpu) {
+        irq_restore(flags);
+        return 0;
+    }
+    spin_lock(&kernel_lock);
+    kernel_lock_owner = cpu;
+    irq_restore(flags);
+    return 1;
+}
+
+/*
+ * unlock_kernel(int taken)
+ *   DESCRIPTION: Releases the big kernel lock if the matching lock_kernel
+ *                took it.
+ *   INPUTS: int taken - what lock_kernel returned, or 1 to release it
+ *                       outright before leaving for user mode.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void unlock_kernel(int taken)
+{
+    int flags = 0;
+
+    if (!taken) {
+        return;
+    }
+    irq_save(flags);
+    kernel_lock_owner = NULL;
+    spin_unlock(&kernel_lock);
+    irq_restore(flags);
+}
+
+/*
+ * kernel_locked()
+ *   DESCRIPTION: Checks whether this CPU holds the big kernel lock.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if it does, 0 if not.
+ *   SIDE EFFECTS: none
+ */
+int kernel_locked()
+{
+    return kernel_lock_owner == this_cpu();
+}
+
+/*
+ * mutex_init(mutex_t * mutex)
+ *   DESCRIPTION: Sets a mutex to unlocked.
+ *   INPUTS: mutex_t * mutex - the mutex.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void mutex_init(mutex_t * mutex)
+{
+    spin_lock_init(&mutex->lock);
+    mutex->owner = MUTEX_FREE;
+    wait_queue_init(&mutex->waiters);
+}
+
+/*
+ * mutex_lock(mutex_t * mutex)
+ *   DESCRIPTION: Takes a mutex, sleeping until it is free.
+ *   INPUTS: mutex_t * mutex - the mutex.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May block the current process.
+ */
+void mutex_lock(mutex_t * mutex)
+{
+    int flags = 0;
+
+    spin_lock_irqsave(&mutex->lock, flags);
+    while (mutex->owner != MUTEX_FREE) {
+        // Interrupts stay off from here into the sleep, so the unlock's
+        // wake cannot come in between and be lost.
+        spin_unlock(&mutex->lock);
+        wait_queue_sleep(&mutex->waiters);
+        spin_lock(&mutex->lock);
+    }
+    mutex->owner = current_pid;
+    spin_unlock_irqrestore(&mutex->lock, flags);
+}
+
+/*
+ * mutex_unlock(mutex_t * mutex)
+ *   DESCRIPTION: Releases a mutex and wakes the processes waiting for it.
+ *   INPUTS: mutex_t * mutex - the mutex.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void mutex_unlock(mutex_t * mutex)
+{
+    int flags = 0;
+
+    spin_lock_irqsave(&mutex->lock, flags);
+    mutex->owner = MUTEX_FREE;
+    spin_unlock(&mutex->lock);
+    wait_queue_wake(&mutex->waiters);
+    irq_restore(flags);
+}
+
+/*
+ * irqoff_start(const char * file, int line)
+ *   DESCRIPTION: Notes that interrupts just went off at a call site. Called
+ *                by irq_save with IRQOFF_DEBUG.
+ *   INPUTS: const char * file - source file of the call site.
+ *           int line - line of the call site.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts off.
+ */
+void irqoff_start(const char * file, int line)
+{
+    irqoff_file = file;
+    irqoff_line = line;
+    irqoff_since = rdtsc();
+}
+
+/*
+ * irqoff_end()
+ *   DESCRIPTION: Charges the interval since irqoff_start to its call site.
+ *                Called by irq_restore with IRQOFF_DEBUG.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts off. Sites past IRQOFF_SITES are
+ *                 not recorded.
+ */
+void irqoff_end()
+{
+    uint32_t cycles = rdtsc() - irqoff_since;
+    irqoff_site_t * site;
+    int i;
+
+    if (irqoff_file == NULL) {
+        return;
+    }
+    for (i = 0; i < irqoff_num_sites; i++) {
+        site = &irqoff_sites[i];
+        if (site->line == irqoff_line && site->file == irqoff_file) {
+            break;
+        }
+    }
+    if (i == irqoff_num_sites) {
+        if (i == IRQOFF_SITES) {
+            irqoff_file = NULL;
+            return;
+        }
+        site = &irqoff_sites[irqoff_num_sites++];
+        site->file = irqoff_file;
+        site->line = irqoff_line;
+        site->count = 0;
+        site->max_cycles = 0;
+    }
+    site->count++;
+    if (cycles > site->max_cycles) {
+        site->max_cycles = cycles;
+    }
+    irqoff_file = NULL;
+}
+
+/*
+ * irqoff_report()
+ *   DESCRIPTION: Prints every recorded call site with its longest
+ *                interrupts-off interval, longest first.
+ *   INPUTS: none
+ *   OUTPUTS: Prints to the screen.
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void irqoff_report()
+{
+    uint32_t printed = 0;
+    uint32_t bound = 0xFFFFFFFF;
+    uint32_t best;
+    int i;
+
+    // Selection by falling bound, so the table itself is left in order.
+    while (printed < (uint32_t)irqoff_num_sites) {
+        best = 0;
+        for (i = 0; i < irqoff_num_sites; i++) {
+            if (irqoff_sites[i].max_cycles < bound && irqoff_sites[i].max_cycles >= best) {
+                best = irqoff_sites[i].max_cycles;
+            }
+        }
+        for (i = 0; i < irqoff_num_sites; i++) {
+            if (irqoff_sites[i].max_cycles == best) {
+                printf("%s:%d: %u cycles max over %u\n", irqoff_sites[i].file,
+                    irqoff_sites[i].line, best, irqoff_sites[i].count);
+                printed++;
+            }
+        }
+        if (best == 0) {
+            break;
+        }
+        bound = best;
+    }
+}
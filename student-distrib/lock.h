@@ -0,0 +1,169 @@
+/* lock.h - Spinlocks, interrupt-safe locks and sleeping mutexes.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#include "types.h"
+#include "lib.h"
+#include "wait_queue.h"
+
+// Uncomment to record the longest interrupts-off interval of each
+// irq_save call site. irqoff_report prints them.
+// #define IRQOFF_DEBUG
+
+#define EFLAGS_IF           0x200   // Interrupt enable flag in EFLAGS.
+#define IRQOFF_SITES        32      // Call sites irqoff tracking keeps.
+#define MUTEX_FREE          -1      // Owner of an unlocked mutex.
+
+// Spinlock Structure. Protects data shared with other CPUs. Taking one
+// does not disable interrupts; use the _irqsave forms for data that
+// interrupt handlers also touch.
+typedef struct spinlock
+{
+    volatile uint32_t locked;
+} spinlock_t;
+
+// Mutex Structure. A lock held across sleeps. Waiters block instead of
+// spinning, so it may only be taken by a process, never in an interrupt.
+typedef struct mutex
+{
+    spinlock_t lock;
+    int owner;                  // Holding process, MUTEX_FREE if unlocked.
+    wait_queue_t waiters;
+} mutex_t;
+
+// Interrupts-off Site Structure, for IRQOFF_DEBUG.
+typedef struct irqoff_site
+{
+    const char * file;
+    int line;
+    uint32_t count;             // Intervals recorded.
+    uint32_t max_cycles;        // Longest of them.
+} irqoff_site_t;
+
+irqoff_site_t irqoff_sites[IRQOFF_SITES];
+int irqoff_num_sites;
+
+struct cpu;
+
+// The Big Kernel Lock. The kernel's own data is not safe against two CPUs
+// at once, so a CPU holds this while it runs kernel code for a process:
+// from an interrupt, exception or system call until it is back in user
+// mode or has switched to a context that does not hold it. The idle loop
+// and user mode run without it.
+spinlock_t kernel_lock;
+struct cpu * volatile kernel_lock_owner;   // CPU holding kernel_lock, NULL if free.
+
+extern void irqoff_start(const char * file, int line);
+extern void irqoff_end();
+extern void irqoff_report();
+
+/* Disable interrupts, saving EFLAGS into "flags". Pairs with irq_restore.
+ * With IRQOFF_DEBUG, the time until interrupts are back on is charged to
+ * this call site. */
+#ifdef IRQOFF_DEBUG
+#define irq_save(flags)                         \
+do {                                            \
+    cli_and_save(flags);                        \
+    if ((flags) & EFLAGS_IF) {                  \
+        irqoff_start(__FILE__, __LINE__);       \
+    }                                           \
+} while (0)
+
+#define irq_restore(flags)                      \
+do {                                            \
+    if ((flags) & EFLAGS_IF) {                  \
+        irqoff_end();                           \
+    }                                           \
+    restore_flags(flags);                       \
+} while (0)
+#else
+#define irq_save(flags)     cli_and_save(flags)
+#define irq_restore(flags)  restore_flags(flags)
+#endif
+
+/*
+ * spin_lock_init(spinlock_t * lock)
+ *   DESCRIPTION: Sets a spinlock to unlocked.
+ *   INPUTS: spinlock_t * lock - the lock.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static inline void spin_lock_init(spinlock_t * lock)
+{
+    lock->locked = 0;
+}
+
+/*
+ * spin_trylock(spinlock_t * lock)
+ *   DESCRIPTION: Takes a spinlock if it is free.
+ *   INPUTS: spinlock_t * lock - the lock.
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the lock was taken, 0 if it is held.
+ *   SIDE EFFECTS: none
+ */
+static inline int spin_trylock(spinlock_t * lock)
+{
+    uint32_t old = 1;
+
+    asm volatile ("xchgl %0, %1"
+            : "+r"(old), "+m"(lock->locked)
+            :
+            : "memory"
+    );
+    return old == 0;
+}
+
+/*
+ * spin_lock(spinlock_t * lock)
+ *   DESCRIPTION: Takes a spinlock, spinning until it is free. Spins on a
+ *                plain read so waiting CPUs do not fight over the line.
+ *   INPUTS: spinlock_t * lock - the lock.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static inline void spin_lock(spinlock_t * lock)
+{
+    while (!spin_trylock(lock)) {
+        while (lock->locked) {
+            asm volatile ("pause");
+        }
+    }
+}
+
+/*
+ * spin_unlock(spinlock_t * lock)
+ *   DESCRIPTION: Releases a spinlock.
+ *   INPUTS: spinlock_t * lock - the lock.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static inline void spin_unlock(spinlock_t * lock)
+{
+    asm volatile ("" : : : "memory");
+    lock->locked = 0;
+}
+
+/* Disable interrupts, then take a spinlock */
+#define spin_lock_irqsave(lock, flags)          \
+do {                                            \
+    irq_save(flags);                            \
+    spin_lock(lock);                            \
+} while (0)
+
+/* Release a spinlock, then restore interrupts */
+#define spin_unlock_irqrestore(lock, flags)     \
+do {                                            \
+    spin_unlock(lock);                          \
+    irq_restore(flags);                         \
+} while (0)
+
+extern int lock_kernel();
+extern void unlock_kernel(int taken);
+extern int kernel_locked();
+extern void mutex_init(mutex_t * mutex);
+extern void mutex_lock(mutex_t * mutex);
+extern void mutex_unlock(mutex_t * mutex);
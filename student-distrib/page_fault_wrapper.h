@@ -0,0 +1,10 @@
+/* page_fault_wrapper.h - Assembly linkage wrapper for the page fault handler.
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _PAGEFAULTWRAPPER_H
+#define _PAGEFAULTWRAPPER_H
+
+extern void page_fault_wrapper();
+
+#endif
@@ -0,0 +1,147 @@
+/* poll.c - Waiting on several files at once.
+ * vim:ts=4 noexpandtab
+ */
+#include "poll.h"
+#include "syscalls.h"
+#include "process_control.h"
+#include "clocksource.h"
+#include "lock.h"
+
+/*
+ * poll_timer_expired(int pid)
+ *   DESCRIPTION: Timer function for a poll with a timeout. Wakes the
+ *                pollers, which find their own time is up.
+ *   INPUTS: int pid - the polling process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: puts every poller back on the run queue
+ */
+static void poll_timer_expired(int pid)
+{
+    wait_queue_wake(&poll_wait_queue);
+}
+
+/*
+ * poll_scan(pollfd_t * fds, int32_t nfds)
+ *   DESCRIPTION: Asks the driver of each file in fds which of its events
+ *                are ready and fills in revents. A driver without a poll
+ *                hook never blocks, so it is always ready.
+ *   INPUTS: pollfd_t * fds - the user's array
+ *           int32_t nfds - entries in it
+ *   OUTPUTS: revents of every entry
+ *   RETURN VALUE: The number of entries with revents set.
+ *   SIDE EFFECTS: Called with interrupts off. The hooks may arm their
+ *                 device to wake poll_wait_queue.
+ */
+static int32_t poll_scan(pollfd_t * fds, int32_t nfds)
+{
+    pcb_t * pcb = &control_blocks[current_pid];
+    optable_t * ops;
+    int32_t ready = 0;
+    int32_t mask;
+    int32_t fd;
+    int32_t i;
+
+    for (i = 0; i < nfds; i++)
+    {
+        fds[i].revents = 0;
+        fd = fds[i].fd;
+        if (fd < 0) {
+            continue;
+        }
+
+        ops = NULL;
+        if (fd < FDT_SIZE) {
+            spin_lock(&pcb->fd_lock);
+            if (pcb->fd_table[fd].flags != -1) {
+                ops = pcb->fd_table[fd].file_operations_pointer;
+            }
+            spin_unlock(&pcb->fd_lock);
+        }
+
+        if (ops == NULL) {
+            mask = POLLNVAL;
+        } else if (ops->poll == NULL) {
+            mask = (POLLIN | POLLOUT) & fds[i].events;
+        } else {
+            mask = ops->poll(fd) & fds[i].events;
+        }
+        fds[i].revents = mask;
+        if (mask != 0) {
+            ready++;
+        }
+    }
+    return ready;
+}
+
+/*
+ * poll_fds(pollfd_t * fds, int32_t nfds, int32_t timeout_ms)
+ *   DESCRIPTION: Waits until one of the files in fds is ready for the
+ *                events asked for, or the timeout runs out. The process
+ *                sleeps on poll_wait_queue in the meantime, which the
+ *                keyboard and RTC wake whenever a file may have become
+ *                ready; every poller then scans its files again.
+ *   INPUTS: pollfd_t * fds - array of nfds entries
+ *           int32_t nfds - entries in fds
+ *           int32_t timeout_ms - longest wait in milliseconds, rounded up
+ *                                to whole ticks. 0 only checks, negative
+ *                                waits for as long as it takes.
+ *   OUTPUTS: revents of every entry in fds
+ *   RETURN VALUE: The number of entries with revents set, 0 on timeout.
+ *   SIDE EFFECTS: may give up the CPU
+ */
+int32_t poll_fds(pollfd_t * fds, int32_t nfds, int32_t timeout_ms)
+{
+    pcb_t * pcb = &control_blocks[current_pid];
+    uint32_t target = 0;
+    int32_t ready;
+    int flags = 0;
+
+    // Interrupts stay off from each scan to the sleep, so a wake in
+    // between is not lost.
+    irq_save(flags);
+    if (timeout_ms > 0) {
+        target = tick_count + clock_peek_ticks() + ns_to_ticks((uint64_t)timeout_ms * NS_PER_MS) + 1;
+        timer_init(&pcb->sleep_timer, poll_timer_expired, current_pid);
+    }
+    while ((ready = poll_scan(fds, nfds)) == 0 && timeout_ms != 0)
+    {
+        if (timeout_ms > 0) {
+            if ((int32_t)(target - tick_count) <= 0) {
+                break;
+            }
+            timer_add(&pcb->sleep_timer, target);
+        }
+        wait_queue_sleep(&poll_wait_queue);
+    }
+    if (timeout_ms > 0) {
+        timer_cancel(&pcb->sleep_timer);
+    }
+    irq_restore(flags);
+    return ready;
+}
+
+/*
+ * poll(pollfd_t * fds, int32_t nfds, int32_t timeout_ms)
+ *   DESCRIPTION: The poll system call. Checks the user's array and waits
+ *                on it with poll_fds.
+ *   INPUTS: pollfd_t * fds - user array of up to FDT_SIZE entries
+ *           int32_t nfds - entries in fds
+ *           int32_t timeout_ms - as for poll_fds
+ *   OUTPUTS: revents of every entry in fds
+ *   RETURN VALUE: The number of entries with revents set, 0 on timeout,
+ *                 -1 if fds is not all in the program's memory or nfds is
+ *                 out of range.
+ *   SIDE EFFECTS: may give up the CPU
+ */
+int32_t poll(pollfd_t * fds, int32_t nfds, int32_t timeout_ms)
+{
+    if (nfds < 0 || nfds > FDT_SIZE) {
+        return FAILURE;
+    }
+    if ((uint32_t)fds < USER_PAGE_START ||
+        (uint32_t)fds > USER_PAGE_START + M_4 - nfds * sizeof(pollfd_t)) {
+        return FAILURE;
+    }
+    return poll_fds(fds, nfds, timeout_ms);
+}
@@ -0,0 +1,21 @@
+/* poll.h - Waiting on several files at once.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#include "types.h"
+
+#define POLLIN      0x001   // A read would not block.
+#define POLLOUT     0x004   // A write would not block.
+#define POLLNVAL    0x020   // The fd is not open. Reported whatever was asked.
+
+// Poll File Descriptor Structure. One entry of the array passed to poll.
+typedef struct pollfd
+{
+    int32_t fd;                 // File to check, ignored if negative.
+    int16_t events;             // POLLIN and POLLOUT to wait for.
+    int16_t revents;            // Set by poll to the events that are ready.
+} pollfd_t;
+
+extern int32_t poll_fds(pollfd_t * fds, int32_t nfds, int32_t timeout_ms);
+extern int32_t poll(pollfd_t * fds, int32_t nfds, int32_t timeout_ms);
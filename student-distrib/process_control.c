@@ -2,6 +2,9 @@
  * vim:ts=4 noexpandtab
  */
 #include "process_control.h"
+#include "apic.h"
+
+extern void set_control_registers_paging(uint32_t * page);
 
 /*
  * process_control_block_init()
@@ -21,10 +24,12 @@ int process_control_block_init()
     stdout->read = &terminal_read_fail;
     stdout->write = &terminal_write;
     stdout->close = &terminal_close;
+    stdout->poll = NULL;
     stdin->open = &keyboard_open;
     stdin->read = &terminal_read;
     stdin->write = &keyboard_write;
     stdin->close = &keyboard_close;
+    stdin->poll = &terminal_poll;
 
     stdin_block.file_operations_pointer = stdin;
     stdout_block.file_operations_pointer = stdout;
@@ -34,6 +39,10 @@ int process_control_block_init()
     stdout_block.file_position = 0;
     stdin_block.flags = 1;
     stdout_block.flags = 1;
+    stdin_block.block_index = 0;
+    stdout_block.block_index = 0;
+    stdin_block.block_data = NULL;
+    stdout_block.block_data = NULL;
 
     int pcbIdx = 0;
     for (pcbIdx = 0; pcbIdx < TOTAL_PROCESSES; pcbIdx++)
@@ -51,11 +60,13 @@ int process_control_block_init()
     file->read = &file_read;
     file->write = &file_write;
     file->close = &file_close;
+    file->poll = NULL; /** Reads never block */
 
     dir->open = &directory_open;
     dir->read = &directory_read;
     dir->write = &directory_write;
     dir->close = &directory_close;
+    dir->poll = NULL;
 
     for (pcbIdx = 0; pcbIdx < TOTAL_PROCESSES; pcbIdx++)
     {
@@ -93,6 +104,8 @@ int first_process_init()
     int pid = SENTINEL_PROCESS;
     control_blocks[pid].pid = pid;
     control_blocks[pid].parent = pid;
+    control_blocks[pid].page_directory = process_pages;
+    control_blocks[pid].terminal = 0;
 
     __asm__("movl %%ss, %0"
             : "=r" (control_blocks[pid].ss)
@@ -142,6 +155,14 @@ int create_new_pcb(int parent/*, int ss, int esp*/)
     control_blocks[new_pid].pid = new_pid;
     control_blocks[new_pid].parent = parent;
 
+    spin_lock_init(&control_blocks[new_pid].fd_lock);
+    // stdin and stdout stay open, but start blocking again.
+    for (i = 0; i < 2; i++)
+    {
+        if (control_blocks[new_pid].fd_table[i].flags != -1) {
+            control_blocks[new_pid].fd_table[i].flags &= ~O_NONBLOCK;
+        }
+    }
     for (i = 2; i < FDT_SIZE; i++)
     {
         control_blocks[new_pid].fd_table[i].flags = -1;
@@ -149,6 +170,23 @@ int create_new_pcb(int parent/*, int ss, int esp*/)
         control_blocks[new_pid].fd_table[i].file_operations_pointer = NULL;
     }
 
+    control_blocks[new_pid].mmap_pages = 0;
+    control_blocks[new_pid].exec_start = 0;
+    control_blocks[new_pid].blocked = 0;
+    control_blocks[new_pid].wait_next = WAIT_QUEUE_EMPTY;
+    control_blocks[new_pid].run_ticks = 0;
+    control_blocks[new_pid].ready_ticks = 0;
+    control_blocks[new_pid].sched_esp = 0;
+    control_blocks[new_pid].sched_locked = 1;
+    control_blocks[new_pid].cpu = this_cpu() - cpus;
+    control_blocks[new_pid].on_run_queue = 0;
+    control_blocks[new_pid].level = 0;
+    control_blocks[new_pid].slice_left = SCHED_BASE_SLICE;
+    timer_init(&control_blocks[new_pid].sleep_timer, NULL, new_pid);
+    control_blocks[new_pid].ring = NULL;
+    memset(control_blocks[new_pid].syscalls, 0, sizeof(control_blocks[new_pid].syscalls));
+    wait_queue_init(&control_blocks[new_pid].sleep_queue);
+
     num_active_processes++;
 
     clear_args();
@@ -190,6 +228,7 @@ void load_pcb(int pid, int ss, int esp)
  */
 int destroy_pcb(int pid)
 {
+    timer_cancel(&control_blocks[pid].sleep_timer);
     control_blocks[pid].pid = -1;
     num_active_processes--;
     return SUCCESS;
@@ -216,3 +255,329 @@ void clear_args()
         }
     }
 }
+
+/*
+ * init_program_pages(int pid, uint32_t inode, uint32_t length)
+ *   DESCRIPTION: Sets up the program region of a new process for demand
+ *                paging. Every 4kB page starts out not present and is filled
+ *                in by fault_program_page the first time it is touched.
+ *   INPUTS: int pid - the given process's process ID.
+ *           uint32_t inode - inode of the program image.
+ *           uint32_t length - length of the program image in bytes.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Clears the process's program page table and fault count.
+ */
+void init_program_pages(int pid, uint32_t inode, uint32_t length)
+{
+    int i;
+    for (i = 0; i < PAGE_SIZE; i++)
+    {
+        program_tables[pid][i] = READWRITE_MASK;
+    }
+    control_blocks[pid].exec_inode = inode;
+    control_blocks[pid].exec_length = length;
+    control_blocks[pid].page_faults = 0;
+    control_blocks[pid].frames = 0;
+}
+
+/*
+ * init_page_directory(int pid)
+ *   DESCRIPTION: Builds the given process's page directory: the shared first
+ *                4MB table, the kernel page, the process's program region
+ *                the VIDMAP table of the process's terminal and the local
+ *                APICs. The mmap region starts out not present.
+ *   INPUTS: int pid - the given process's process ID.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Rewrites the process's page directory.
+ */
+void init_page_directory(int pid)
+{
+    int i;
+    uint32_t * directory = page_directories[pid];
+
+    for (i = 0; i < PAGE_SIZE; i++)
+    {
+        directory[i] = READWRITE_MASK;
+    }
+
+    directory[0] = ((uint32_t)process_tables) | USER_MASK | READWRITE_MASK | PRESENT_MASK;
+    directory[1] = KERNEL_USER | GLOBAL_MASK;
+    directory[VIRTUAL_PROGRAM] = ((uint32_t)program_tables[pid]) | USER_MASK | READWRITE_MASK | PRESENT_MASK;
+    directory[VID_IDX] = ((uint32_t)vidmap_tables[control_blocks[pid].terminal]) | USER_MASK | READWRITE_MASK | PRESENT_MASK;
+    apic_map_directory(directory);
+
+    control_blocks[pid].page_directory = directory;
+}
+
+/*
+ * load_page_directory(int pid)
+ *   DESCRIPTION: Switches to the given process's address space.
+ *   INPUTS: int pid - the given process's process ID.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Loads CR3, which flushes the TLB.
+ */
+void load_page_directory(int pid)
+{
+    set_control_registers_paging(control_blocks[pid].page_directory);
+}
+
+/*
+ * set_vidmap_terminal(int terminal)
+ *   DESCRIPTION: Points VIDMAP at the screen for the processes of the
+ *                displayed terminal and at each other terminal's backing
+ *                page for the rest. Called when the displayed terminal changes.
+ *   INPUTS: int terminal - the displayed terminal.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Rewrites the VIDMAP entry of every terminal's table.
+ */
+void set_vidmap_terminal(int terminal)
+{
+    int i;
+    for (i = 0; i < NUM_TERMINALS; i++)
+    {
+        if (i == terminal) {
+            vidmap_tables[i][VID_IDX] = VIDEO | USER_MASK | READWRITE_MASK | PRESENT_MASK;
+        } else {
+            vidmap_tables[i][VID_IDX] = (VIDEO_1 + (PAGE_4KB * i)) | USER_MASK | READWRITE_MASK | PRESENT_MASK;
+        }
+    }
+    invlpg(VIDMAP);
+}
+
+/*
+ * map_program_page(int pid, uint32_t idx)
+ *   DESCRIPTION: Backs one 4kB page of the program region with a frame from
+ *                the frame allocator, then fills it from the program image,
+ *                or zeroes it if it lies outside the image (bss, stack). The
+ *                process's page directory must be the one loaded.
+ *   INPUTS: int pid - the given process's process ID.
+ *           uint32_t idx - page index inside the program region.
+ *   OUTPUTS: none
+ *   RETURN VALUE: SUCCESS if the page was mapped, FAILURE if memory has run
+ *                 out or the image could not be read.
+ *   SIDE EFFECTS: Maps and fills one page of the program region.
+ */
+int32_t map_program_page(int pid, uint32_t idx)
+{
+    uint32_t page;      // Virtual address of the page.
+    uint32_t frame;     // Physical frame backing the page.
+    uint32_t copied;    // Bytes of the image copied into the page.
+    int32_t ret;
+
+    frame = frame_alloc();
+    if (frame == FRAME_NONE) {
+        return FAILURE;
+    }
+
+    page = USER_PAGE_START + (idx << PTE_SHIFT);
+    program_tables[pid][idx] = frame | USER_MASK | READWRITE_MASK | PRESENT_MASK;
+    invlpg(page);
+
+    // Copy whatever part of the image falls in this page, zero the rest.
+    copied = 0;
+    if (page >= VIRTUAL_START && page - VIRTUAL_START < control_blocks[pid].exec_length) {
+        ret = read_data(control_blocks[pid].exec_inode, page - VIRTUAL_START, (uint8_t *)page, PAGE_4KB);
+        if (ret < 0) {
+            program_tables[pid][idx] = READWRITE_MASK;
+            invlpg(page);
+            frame_free(frame);
+            return FAILURE;
+        }
+        copied = ret;
+    }
+    memset((uint8_t *)page + copied, 0, PAGE_4KB - copied);
+
+    control_blocks[pid].frames++;
+    return SUCCESS;
+}
+
+/*
+ * fault_program_page(int pid, uint32_t addr)
+ *   DESCRIPTION: Resolves a fault on a not-present page of the program
+ *                region by mapping the page in with map_program_page.
+ *   INPUTS: int pid - the faulting process's process ID.
+ *           uint32_t addr - the faulting virtual address.
+ *   OUTPUTS: none
+ *   RETURN VALUE: SUCCESS if the page was filled in, FAILURE if the fault is
+ *                 not a demand-paging fault or no frame is left for it.
+ *   SIDE EFFECTS: Maps and fills one page of the program region.
+ */
+int32_t fault_program_page(int pid, uint32_t addr)
+{
+    uint32_t idx;       // Page index inside the program region.
+
+    if (pid == SENTINEL_PROCESS) {
+        return FAILURE;
+    }
+    if (addr < USER_PAGE_START || addr >= USER_PAGE_START + M_4) {
+        return FAILURE;
+    }
+
+    idx = (addr - USER_PAGE_START) >> PTE_SHIFT;
+    if (program_tables[pid][idx] & PRESENT_MASK) {
+        return FAILURE;
+    }
+
+    if (map_program_page(pid, idx) == FAILURE) {
+        return FAILURE;
+    }
+
+    control_blocks[pid].page_faults++;
+    return SUCCESS;
+}
+
+/*
+ * free_program_pages(int pid)
+ *   DESCRIPTION: Gives every frame backing the given process's program
+ *                region back to the frame allocator.
+ *   INPUTS: int pid - the given process's process ID.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Clears the process's program page table. The caller
+ *                 flushes the TLB.
+ */
+void free_program_pages(int pid)
+{
+    int i;
+    for (i = 0; i < PAGE_SIZE; i++)
+    {
+        if (program_tables[pid][i] & PRESENT_MASK) {
+            frame_free(program_tables[pid][i] & ~(PAGE_4KB - 1));
+        }
+        program_tables[pid][i] = READWRITE_MASK;
+    }
+    control_blocks[pid].frames = 0;
+}
+
+/*
+ * load_mmap_pages(int pid)
+ *   DESCRIPTION: Points the mmap region of the process's page directory at
+ *                its mmap page table, or marks it not present if the
+ *                process has nothing mapped.
+ *   INPUTS: int pid - the given process's process ID.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Rewrites the MMAP_IDX entry of the process's page directory.
+ *                 The caller flushes the TLB.
+ */
+void load_mmap_pages(int pid)
+{
+    if (control_blocks[pid].mmap_pages == 0) {
+        control_blocks[pid].page_directory[MMAP_IDX] = READWRITE_MASK;
+    } else {
+        control_blocks[pid].page_directory[MMAP_IDX] = ((uint32_t)mmap_tables[pid]) | USER_MASK | READWRITE_MASK | PRESENT_MASK;
+    }
+}
+
+/*
+ * clear_mmap_pages(int pid)
+ *   DESCRIPTION: Tears down every file mapping made by the given process.
+ *   INPUTS: int pid - the given process's process ID.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Clears the process's mmap page table.
+ */
+void clear_mmap_pages(int pid)
+{
+    int i;
+    for (i = 0; i < control_blocks[pid].mmap_pages; i++)
+    {
+        mmap_tables[pid][i] = READWRITE_MASK;
+    }
+    control_blocks[pid].mmap_pages = 0;
+}
+
+/*
+ * create_kernel_process(void (*entry)())
+ *   DESCRIPTION: Starts a background process on the current CPU. See
+ *                create_kernel_process_on.
+ *   INPUTS: void (*entry)() - function to run. It must finish by calling
+ *                             exit_kernel_process.
+ *   OUTPUTS: none
+ *   RETURN VALUE: The new process ID, or FAILURE if no process is free.
+ *   SIDE EFFECTS: Queues the new process.
+ */
+int create_kernel_process(void (*entry)())
+{
+    return create_kernel_process_on(entry, this_cpu() - cpus);
+}
+
+/*
+ * create_kernel_process_on(void (*entry)(), int cpu)
+ *   DESCRIPTION: Starts a background process that runs a kernel function
+ *                in ring 0 on its own kernel stack. It is not the foreground
+ *                process of any terminal and nothing waits for it; it goes
+ *                straight onto the run queue of the given CPU and is
+ *                scheduled like any other. It starts out holding the kernel
+ *                lock, and stays on that CPU while it holds it.
+ *   INPUTS: void (*entry)() - function to run. It must finish by calling
+ *                             exit_kernel_process.
+ *           int cpu - cpus index of a CPU that runs processes.
+ *   OUTPUTS: none
+ *   RETURN VALUE: The new process ID, or FAILURE if no process is free or
+ *                 the CPU does not run processes.
+ *   SIDE EFFECTS: Queues the new process, and wakes its CPU if that is
+ *                 another one.
+ */
+int create_kernel_process_on(void (*entry)(), int cpu)
+{
+    int flags = 0;
+    int pid;
+
+    if (cpu < 0 || cpu >= sched_cpus) {
+        return FAILURE;
+    }
+
+    cli_and_save(flags);
+    if (num_active_processes >= MAX_PROCESSES) {
+        restore_flags(flags);
+        return FAILURE;
+    }
+    pid = create_new_pcb(current_pid);
+    if (pid == FAILURE) {
+        restore_flags(flags);
+        return FAILURE;
+    }
+
+    // Only kernel memory is touched, which every page directory maps.
+    control_blocks[pid].page_directory = process_pages;
+    control_blocks[pid].terminal = control_blocks[current_pid].terminal;
+    control_blocks[pid].cpu = cpu;
+    build_kernel_context((uint32_t *)(KERNEL_ADDR + M_4 - (2 * K_4 * pid)), entry,
+        &control_blocks[pid].sched_esp);
+    schedule_enqueue(pid);
+    if (cpu != this_cpu() - cpus) {
+        schedule_kick_cpu(cpu);
+    }
+
+    restore_flags(flags);
+    return pid;
+}
+
+/*
+ * exit_kernel_process()
+ *   DESCRIPTION: Ends the calling process from create_kernel_process.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: Never returns.
+ *   SIDE EFFECTS: Frees the process control block. The scheduler drops the
+ *                 context instead of saving it.
+ */
+void exit_kernel_process()
+{
+    cli();
+    destroy_pcb(current_pid);
+    while (1) {
+        schedule_yield();
+        // Still here only without an idle context to switch to. Nothing
+        // is left to protect, so other CPUs need not wait for this one.
+        unlock_kernel(kernel_locked());
+        sti();
+        __asm__ volatile("hlt");
+        cli();
+    }
+}
@@ -5,6 +5,14 @@
 #include "x86_desc.h"
 #include "interrupts.h"
 #include "filesystem_driver.h"
+#include "frame_allocator.h"
+#include "wait_queue.h"
+#include "run_queue.h"
+#include "timer_wheel.h"
+#include "ring.h"
+#include "sysstat.h"
+#include "poll.h"
+#include "smp.h"
 
 #define M_4 0x400000  // Memory
 #define K_4 0x4000    // Kernel
@@ -15,12 +23,21 @@
 #define ENTRY_OFFSET    0x48018   // Memory Entry Offset
 
 #define SENTINEL_PROCESS 0    // Process ID for the sentinel/root parent.
-#define TOTAL_PROCESSES 7     // Total number of processes - including sentinel.
-#define MAX_PROCESSES   6     // Maximum number of processes.
+#define TOTAL_PROCESSES 33    // Total number of processes - including sentinel.
+#define MAX_PROCESSES   32    // Maximum number of processes.
+#define NUM_TERMINALS   3     // Should be in terminal.h
 #define FDT_SIZE        8     // Process control block Size.
 #define PAGE_SIZE       1024  // Page size for our paging
+#define MMAP_IDX        34    // Page directory index of the user mmap region.
+#define MMAP_START      0x8800000 // First virtual address of the user mmap region.
+#define PTE_SHIFT       12    // Shift between an address and its 4kB page number.
+#define PAGE_4KB        0x1000 // Bytes in a 4kB page.
+#define STACK_PAGE_IDX  1023  // Program region page holding the top of the user stack.
 #define EXEC_BUFFER_SIZE 128
 #define ARGS_BUFFER_SIZE 1024
+#define O_NONBLOCK      0x800 // fd_block_t flag: reads that would block fail at once.
+#define F_GETFL         3     // fcntl command to read an fd's O_NONBLOCK.
+#define F_SETFL         4     // fcntl command to set an fd's O_NONBLOCK.
 
 // Operation Table Structure.
 typedef struct optable
@@ -29,6 +46,7 @@ typedef struct optable
     int32_t (*read)(int32_t fd, void* buf, int32_t nbytes);
     int32_t (*write)(int32_t fd, const void* buf, int32_t nbytes );
     int32_t (*close)(int32_t fd);
+    int32_t (*poll)(int32_t fd);    // POLLIN/POLLOUT ready now, NULL if never blocking.
 } optable_t;
 
 // File Descriptor Block Structure.
@@ -37,24 +55,53 @@ typedef struct fd_block
     optable_t *file_operations_pointer;
     int32_t inode;
     uint32_t file_position;
-    int32_t flags;
+    int32_t flags;          // -1 if closed. O_NONBLOCK, except on directories.
+    uint32_t block_index;   // Index into the inode's data_blocks of the cached block.
+    uint8_t * block_data;   // Cached data block for sequential reads, NULL if none.
+    uint32_t rtc_divider;   // Hardware RTC interrupts per virtual one, for rtc files.
+    uint32_t rtc_next;      // rtc_irqs value of the file's next virtual interrupt.
 } fd_block_t;
 
 // Process Control Block Structure.
 typedef struct process_control_block_ {
     fd_block_t fd_table[FDT_SIZE];
+    spinlock_t fd_lock;     // Protects fd_table.
     int pid;
     int parent;
     int stack_pos;
     int ss;
     int esp;
+    int mmap_pages;         // Pages in use in the process's mmap region.
+    uint32_t exec_inode;    // Inode of the program image, for demand paging.
+    uint32_t exec_length;   // Length of the program image in bytes.
+    uint32_t page_faults;   // Program pages filled in on first touch.
+    uint32_t exec_start;    // TSC at execute entry, 0 once its first fault or system call is timed.
+    uint32_t frames;        // Physical frames backing the program region.
+    uint32_t * page_directory;  // Page directory loaded into CR3 while the process runs.
+    int terminal;           // Terminal the process was started on.
+    volatile int blocked;   // Set while sleeping on a wait queue.
+    int wait_next;          // Next sleeper on the same wait queue.
+    uint32_t run_ticks;     // Timer ticks spent running.
+    uint32_t ready_ticks;   // Timer ticks spent running or waiting on the run queue.
+    int sched_esp;          // Stack pointer saved when last switched out.
+    int sched_locked;       // Set if it held the kernel lock when switched out.
+    int cpu;                // cpus index of the CPU it runs on, or last ran on.
+    int on_run_queue;       // Set while waiting on the run queue.
+    int level;              // Scheduling priority level, 0 is the highest.
+    int slice_left;         // Ticks left in the current time slice.
+    wheel_timer_t sleep_timer;  // Wakes the process from sleep or nanosleep.
+    wait_queue_t sleep_queue;   // The process alone, while it sleeps.
+    int run_next;           // Next process on the run queue.
+    int run_prev;           // Previous process on the run queue.
+    uint32_t queued_tick;   // Tick the process joined the run queue.
+    ring_t * ring;          // Submission ring registered by ring_setup, NULL if none.
+    syscall_stat_t syscalls[NUM_SYSCALLS];  // Calls made, by system call number less one.
     uint8_t args[ARGS_BUFFER_SIZE];
 } pcb_t;
 
 // The Global Process Control Blocks and Process ID.
 pcb_t control_blocks[TOTAL_PROCESSES];
 int num_active_processes;
-int current_pid;
 int past_pid;
 
 // Operation table global variables.
@@ -67,10 +114,27 @@ optable_t * stdin;
 optable_t stdout_table;
 optable_t * stdout;
 
-// Per-process page directories and page tables.
+// Boot page directory, used by the sentinel, and the page table for the
+// first 4MB shared by every page directory.
 uint32_t process_pages/*[TOTAL_PROCESSES]*/[PAGE_SIZE] __attribute__((aligned(4 * PAGE_SIZE)));
 uint32_t process_tables/*[TOTAL_PROCESSES]*/[PAGE_SIZE] __attribute__((aligned(4 * PAGE_SIZE)));
 
+// Per-process page directories. The sentinel keeps process_pages.
+uint32_t page_directories[TOTAL_PROCESSES][PAGE_SIZE] __attribute__((aligned(4 * PAGE_SIZE)));
+
+// Per-terminal page tables for VIDMAP, pointing at the screen for the
+// displayed terminal and at the terminal's backing page otherwise.
+uint32_t vidmap_tables[NUM_TERMINALS][PAGE_SIZE] __attribute__((aligned(4 * PAGE_SIZE)));
+
+// Per-process page tables for the 4kB pages of the program region.
+uint32_t program_tables[TOTAL_PROCESSES][PAGE_SIZE] __attribute__((aligned(4 * PAGE_SIZE)));
+uint32_t last_page_faults;  // Demand-paging faults taken by the last process to halt.
+uint32_t last_run_ticks;    // Ticks the last process to halt spent running.
+uint32_t last_ready_ticks;  // Ticks the last process to halt spent runnable.
+
+// Per-process page tables for the read-only file mappings made by mmap.
+uint32_t mmap_tables[TOTAL_PROCESSES][PAGE_SIZE] __attribute__((aligned(4 * PAGE_SIZE)));
+
 extern int create_new_pcb(int parent);
 extern void load_pcb(int pid, int ss, int esp);
 
@@ -78,3 +142,15 @@ extern int destroy_pcb(int pid);
 extern int process_control_block_init();
 extern int first_process_init();
 extern void clear_args();
+extern void init_program_pages(int pid, uint32_t inode, uint32_t length);
+extern void init_page_directory(int pid);
+extern void load_page_directory(int pid);
+extern void set_vidmap_terminal(int terminal);
+extern int32_t map_program_page(int pid, uint32_t idx);
+extern int32_t fault_program_page(int pid, uint32_t addr);
+extern void free_program_pages(int pid);
+extern void load_mmap_pages(int pid);
+extern void clear_mmap_pages(int pid);
+extern int create_kernel_process(void (*entry)());
+extern int create_kernel_process_on(void (*entry)(), int cpu);
+extern void exit_kernel_process();
@@ -0,0 +1,109 @@
+/* ring.c - Submission rings for batched system calls.
+ * vim:ts=4 noexpandtab
+ */
+#include "ring.h"
+#include "syscalls.h"
+#include "process_control.h"
+
+/*
+ * ring_run(ring_sqe_t * sqe)
+ *   DESCRIPTION: Runs one submission through the system call it names,
+ *                which dispatches on the file's optable_t as a trap would.
+ *   INPUTS: ring_sqe_t * sqe - kernel copy of the submission.
+ *   OUTPUTS: none
+ *   RETURN VALUE: The system call's result, -1 for an unknown op.
+ *   SIDE EFFECTS: Those of the system call.
+ */
+static int32_t ring_run(ring_sqe_t * sqe)
+{
+    switch (sqe->op) {
+        case RING_OP_READ:
+            return read(sqe->fd, sqe->buf, sqe->nbytes);
+        case RING_OP_WRITE:
+            return write(sqe->fd, sqe->buf, sqe->nbytes);
+        case RING_OP_OPEN:
+            return open((const uint8_t *)sqe->buf);
+        case RING_OP_CLOSE:
+            return close(sqe->fd);
+        default:
+            return FAILURE;
+    }
+}
+
+/*
+ * ring_setup(ring_t * ring)
+ *   DESCRIPTION: Registers the calling process's ring, and empties it.
+ *   INPUTS: ring_t * ring - user pointer to the ring, NULL to drop it.
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the ring is not all in the program's
+ *                 memory.
+ *   SIDE EFFECTS: Replaces any ring registered before.
+ */
+int32_t ring_setup(ring_t * ring)
+{
+    pcb_t * pcb = &control_blocks[current_pid];
+
+    if (ring == NULL) {
+        pcb->ring = NULL;
+        return 0;
+    }
+    if ((uint32_t)ring < USER_PAGE_START ||
+        (uint32_t)ring > USER_PAGE_START + M_4 - sizeof(ring_t)) {
+        return FAILURE;
+    }
+    ring->sq_head = 0;
+    ring->sq_tail = 0;
+    ring->cq_head = 0;
+    ring->cq_tail = 0;
+    pcb->ring = ring;
+    return 0;
+}
+
+/*
+ * ring_enter(void)
+ *   DESCRIPTION: Runs the submissions queued on the calling process's ring,
+ *                in order, and posts a completion for each. A RING_LINK
+ *                entry takes its byte count from the entry before it, so a
+ *                read can be chained to the write of what it read; it is
+ *                skipped, completing with the same result, if that entry
+ *                failed or returned 0. Stops early when the completion
+ *                queue is full.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: Submissions run, or -1 with no ring or a corrupt one.
+ *   SIDE EFFECTS: Those of the system calls run. May block.
+ */
+int32_t ring_enter(void)
+{
+    ring_t * ring = control_blocks[current_pid].ring;
+    ring_cqe_t * cqe;
+    ring_sqe_t sqe;
+    int32_t result = 0;
+    int32_t done = 0;
+
+    if (ring == NULL || ring->sq_tail - ring->sq_head > RING_ENTRIES) {
+        return FAILURE;
+    }
+
+    while (ring->sq_head != ring->sq_tail && ring->cq_tail - ring->cq_head < RING_ENTRIES) {
+        // Copy the entry, so the process cannot change it while it runs.
+        sqe = ring->sqes[ring->sq_head % RING_ENTRIES];
+        ring->sq_head++;
+
+        if (sqe.flags & RING_LINK) {
+            if (result > 0) {
+                sqe.nbytes = result;
+                result = ring_run(&sqe);
+            }
+        } else {
+            result = ring_run(&sqe);
+        }
+
+        cqe = &ring->cqes[ring->cq_tail % RING_ENTRIES];
+        cqe->user_data = sqe.user_data;
+        cqe->result = result;
+        ring->cq_tail++;
+        done++;
+    }
+    return done;
+}
@@ -0,0 +1,49 @@
+/* ring.h - Submission rings for batched system calls.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#include "types.h"
+
+#define RING_ENTRIES    128     // Entries in each queue, so a ring fits in a 4kB page.
+#define RING_OP_READ    0
+#define RING_OP_WRITE   1
+#define RING_OP_OPEN    2       // buf is the file name.
+#define RING_OP_CLOSE   3
+#define RING_LINK       0x1     // nbytes is the previous entry's result; skipped if that was <= 0.
+
+// Submission Queue Entry. One system call for ring_enter to run.
+typedef struct ring_sqe
+{
+    uint16_t op;                // RING_OP_*.
+    uint16_t flags;             // RING_LINK.
+    int32_t fd;
+    void * buf;
+    int32_t nbytes;
+    uint32_t user_data;         // Copied to the entry's completion.
+} ring_sqe_t;
+
+// Completion Queue Entry. The result of one submission, in order.
+typedef struct ring_cqe
+{
+    uint32_t user_data;
+    int32_t result;             // What the system call returned.
+} ring_cqe_t;
+
+// Ring Structure. Lives in the process's memory and is shared with the
+// kernel. Indices run freely and are taken modulo RING_ENTRIES. The process
+// fills sqes and moves sq_tail up, the kernel moves sq_head up as it runs
+// them; the kernel fills cqes and moves cq_tail up, the process moves
+// cq_head up as it reads them.
+typedef struct ring
+{
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    ring_sqe_t sqes[RING_ENTRIES];
+    ring_cqe_t cqes[RING_ENTRIES];
+} ring_t;
+
+extern int32_t ring_setup(ring_t * ring);
+extern int32_t ring_enter(void);
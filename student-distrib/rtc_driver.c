@@ -18,11 +18,57 @@ void rtc_optable()
   rtc->read = &rtc_read;
   rtc->write = &rtc_write;
   rtc->close = &rtc_close;
+  rtc->poll = &rtc_poll;
+}
+
+/*
+ * rtc_periodic
+ *   DESCRIPTION: Turns the RTC's periodic interrupt on or off. The rate stays
+ *                at RTC_HW_RATE; readers divide it down in rtc_read.
+ *   INPUTS: int on - nonzero to start the interrupt, zero to stop it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with rtc_lock held. Masks IRQ8 while stopped.
+ */
+static void rtc_periodic(int on)
+{
+    char prev;
+
+    outb(RTC_REG_B, CMOS_REG);
+    prev = inb(RTC_REG);
+    outb(RTC_REG_B, CMOS_REG);
+    if (on) {
+        outb(prev | RTC_PIE, RTC_REG);
+        // Drop any interrupt left pending from before it was stopped.
+        outb(RTC_REG_C, CMOS_REG);
+        inb(RTC_REG);
+        enable_irq(IRQ8);
+    } else {
+        outb(prev & ~RTC_PIE, RTC_REG);
+        disable_irq(IRQ8);
+    }
+}
+
+/*
+ * rtc_fd_valid
+ *   DESCRIPTION: Checks that fd is an open rtc file of the current process.
+ *   INPUTS: int32_t fd - file descriptor
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if it is, 0 if not
+ *   SIDE EFFECTS: Called with the process's fd_lock held.
+ */
+static int rtc_fd_valid(int32_t fd)
+{
+    if (fd < 2 || fd >= FDT_SIZE) {
+        return 0;
+    }
+    return control_blocks[current_pid].fd_table[fd].file_operations_pointer == rtc;
 }
 
 /*
  * rtc_open
- *   DESCRIPTION: Sets the RTC frequency to twice a second
+ *   DESCRIPTION: Opens the RTC at twice a second. The first open starts the
+ *                hardware RTC.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: PCB index on success, -1 on failure
@@ -30,150 +76,200 @@ void rtc_optable()
  */
 int32_t rtc_open(const uint8_t* filename)
 {
-    int ret;            /** return value */
     int i;              /** loop variable */
-    int32_t open;           /** keeps track of open spot on pcb */
+    int32_t open;       /** keeps track of open spot on pcb */
     fd_block_t  fblock; /** file descriptor block to be assigned */
+    pcb_t * pcb = &control_blocks[current_pid];
     int flags = 0;
-    int rate = 15;
-    ret = 0;
-    i = 0;
-    open = 0;
-    cli_and_save(flags);
+    open = -1;
 
+    fblock.file_operations_pointer = rtc;
+    fblock.inode = 0;
+    fblock.file_position = 0;
+    fblock.flags = 1;
+    fblock.block_index = 0;
+    fblock.block_data = NULL;
+    fblock.rtc_divider = RTC_HW_RATE / RTC_DEFAULT_RATE;
+    fblock.rtc_next = rtc_irqs + fblock.rtc_divider;
 
-    /** returns -1 if file already open */
+    spin_lock_irqsave(&pcb->fd_lock, flags);
     for (i = 2; i < FDT_SIZE; i++)
     {
-        if (control_blocks[current_pid].fd_table[i].flags == -1) {
-          continue;
-        }
-        if (control_blocks[current_pid].fd_table[i].file_operations_pointer == rtc) {
+        /** returns -1 if file already open */
+        if (pcb->fd_table[i].flags != -1 && pcb->fd_table[i].file_operations_pointer == rtc) {
+            spin_unlock_irqrestore(&pcb->fd_lock, flags);
             return -1;
         }
-    }
-
-    /** Check the ret */
-    if (ret == -1) {
-        return ret;
-    }
-    for (i = 2; i < FDT_SIZE; i++)
-    {
-        /** the control block is empty, take it */
-        if (control_blocks[current_pid].fd_table[i].flags == -1) {
+        /** the first empty control block is taken */
+        if (pcb->fd_table[i].flags == -1 && open == -1) {
             open = i;
-            break;
-        }
-        /** If there is not anavailable spot, return -1 */
-        if (i == FDT_SIZE ) {
-            return -1;
         }
     }
+    /** If there is not an available spot, return -1 */
+    if (open == -1) {
+        spin_unlock_irqrestore(&pcb->fd_lock, flags);
+        return -1;
+    }
+    pcb->fd_table[open] = fblock;
+    spin_unlock(&pcb->fd_lock);
 
-    // Need to disable interrupts
-
-    outb(0x8A, CMOS_REG);
-    char exisiting = inb(RTC_REG);
-    outb(0x8A,CMOS_REG);
-
-    /** Send the rate to the RTC */
-    outb((exisiting & 0xF0) | rate, RTC_REG);
-
-    // Need to enable interrupts
-    restore_flags(flags);
-    fblock.file_operations_pointer = rtc;
-    fblock.inode = 0;
-    fblock.flags = 1;
-    // Set flags and file position?
-    control_blocks[current_pid].fd_table[open] = fblock;
-    sti();
+    spin_lock(&rtc_lock);
+    if (rtc_open_count++ == 0) {
+        rtc_periodic(1);
+    }
+    spin_unlock_irqrestore(&rtc_lock, flags);
     return open;
 }
 
 /*
  * rtc_close
- *   DESCRIPTION: returns zero
- *   INPUTS:
+ *   DESCRIPTION: Closes an rtc file. The last close stops the hardware RTC.
+ *   INPUTS: int32_t fd - file descriptor
  *   OUTPUTS: none
  *   RETURN VALUE: 0 on success, -1 on failure
  *   SIDE EFFECTS: none
  */
 int32_t rtc_close(int32_t fd)
 {
-    cli();
+    pcb_t * pcb = &control_blocks[current_pid];
+    int flags = 0;
+
+    spin_lock_irqsave(&pcb->fd_lock, flags);
     /** Check for fd validity */
-    if (fd < 2 || fd >= FDT_SIZE) {
-        return -1;
-    }
-    if (control_blocks[current_pid].fd_table[fd].flags == 0) {
+    if (!rtc_fd_valid(fd)) {
+        spin_unlock_irqrestore(&pcb->fd_lock, flags);
         return -1;
     }
     /** Clear the control block entry */
-    control_blocks[current_pid].fd_table[fd].file_operations_pointer = NULL;
-    control_blocks[current_pid].fd_table[fd].flags = -1;
-    control_blocks[current_pid].fd_table[fd].inode = -1;
-    sti();
+    pcb->fd_table[fd].file_operations_pointer = NULL;
+    pcb->fd_table[fd].flags = -1;
+    pcb->fd_table[fd].inode = -1;
+    spin_unlock(&pcb->fd_lock);
+
+    spin_lock(&rtc_lock);
+    if (--rtc_open_count == 0) {
+        rtc_periodic(0);
+    }
+    spin_unlock_irqrestore(&rtc_lock, flags);
     return 0;
 }
 
 /*
  * rtc_read
- *   DESCRIPTION: Waits for an interrupt from the rtc and then writes character
- *   to the terminal
- *   INPUTS: none
+ *   DESCRIPTION: Waits for the file's next virtual interrupt. Virtual
+ *                interrupts fall every rtc_divider hardware ones, so a
+ *                reader that keeps up wakes at exactly its own rate. One
+ *                that falls behind returns at once for the interrupt it
+ *                missed and skips the rest, up to the next one still ahead.
+ *   INPUTS: int32_t fd - file descriptor
  *   OUTPUTS: none
- *   RETURN VALUE: 0 on success
- *   SIDE EFFECTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure or, with O_NONBLOCK, if the
+ *                 next virtual interrupt has not come yet
+ *   SIDE EFFECTS: Blocks the current process unless the file is O_NONBLOCK.
  */
 int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes)
 {
-int cip = current_process;
-	sti();
-  rtc_virtual_interupt[cip] = 0;
-    /* Wait for the interrupt to trigger the flag */
-    while (rtc_virtual_interupt[cip] < 1) {}
-  rtc_virtual_interupt[cip] = 0;
-  cli();
+    pcb_t * pcb = &control_blocks[current_pid];
+    fd_block_t * fblock;
+    uint32_t behind;
+    int valid;
+    int flags = 0;
+
+    spin_lock_irqsave(&pcb->fd_lock, flags);
+    valid = rtc_fd_valid(fd);
+    spin_unlock(&pcb->fd_lock);
+    if (!valid) {
+        irq_restore(flags);
+        return -1;
+    }
+    fblock = &pcb->fd_table[fd];
+
+    spin_lock(&rtc_lock);
+    if ((fblock->flags & O_NONBLOCK) && (int32_t)(rtc_irqs - fblock->rtc_next) < 0) {
+        spin_unlock_irqrestore(&rtc_lock, flags);
+        return FAILURE;
+    }
+
+    /* Sleep until the interrupt count reaches the next virtual interrupt */
+    while ((int32_t)(rtc_irqs - fblock->rtc_next) < 0) {
+        if ((int32_t)(fblock->rtc_next - rtc_wake_at) < 0) {
+            rtc_wake_at = fblock->rtc_next;
+        }
+        spin_unlock(&rtc_lock);
+        wait_queue_sleep(&rtc_wait_queue);
+        spin_lock(&rtc_lock);
+    }
+
+    /* Take it, and any missed since, so rtc_next is always still to come */
+    behind = rtc_irqs - fblock->rtc_next;
+    fblock->rtc_next += (behind / fblock->rtc_divider + 1) * fblock->rtc_divider;
+    spin_unlock_irqrestore(&rtc_lock, flags);
     return SUCCESS;
 }
 
+/*
+ * rtc_poll
+ *   DESCRIPTION: Readiness hook for poll. An rtc file is readable once its
+ *                next virtual interrupt has come. Until then the RTC
+ *                interrupt is asked to wake poll_wait_queue at that time.
+ *   INPUTS: int32_t fd - file descriptor
+ *   OUTPUTS: none
+ *   RETURN VALUE: POLLIN if a read would not block, else 0
+ *   SIDE EFFECTS: May move rtc_wake_at earlier.
+ */
+int32_t rtc_poll(int32_t fd)
+{
+    fd_block_t * fblock = &control_blocks[current_pid].fd_table[fd];
+    int32_t ready;
+    int flags = 0;
+
+    spin_lock_irqsave(&rtc_lock, flags);
+    ready = (int32_t)(rtc_irqs - fblock->rtc_next) >= 0;
+    if (!ready && (int32_t)(fblock->rtc_next - rtc_wake_at) < 0) {
+        rtc_wake_at = fblock->rtc_next;
+    }
+    spin_unlock_irqrestore(&rtc_lock, flags);
+    return ready ? POLLIN : 0;
+}
+
 /*
  * rtc_write
- *   DESCRIPTION: Sets the frequency of the RTC to the passed in rate
- *   INPUTS: int32_t rate
+ *   DESCRIPTION: Sets the file's virtual interrupt rate. Other rtc files,
+ *                and the hardware rate, are unaffected.
+ *   INPUTS: int32_t fd - file descriptor
+ *           const void* buf - the rate in Hz, a power of two from 2 to
+ *                             MAX_RTC_RATE
+ *           int32_t rate_size - size of the rate, 4 bytes
  *   OUTPUTS: none
  *   RETURN VALUE: 0 on success, -1 on failure
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: Restarts the file's virtual interrupts from now.
  */
 int32_t rtc_write(int32_t fd, const void* buf, int32_t rate_size)
 {
-  int flags = 0;
-  cli_and_save(flags);
-    int rate = 0x0F;
-    int passed_rate;
-    int mask;
+    pcb_t * pcb = &control_blocks[current_pid];
+    int32_t passed_rate;
+    int valid;
+    int flags = 0;
+
+    if (buf == NULL || rate_size != sizeof(int32_t)) {
+        return FAILURE;
+    }
     memcpy(&passed_rate, buf, rate_size);
-    for (mask = 2; mask <= MAX_RTC_RATE; mask *= 2)
-    {
-        if (mask == passed_rate) {
-            break;
-        } else if (mask == MAX_RTC_RATE) {
-            return FAILURE;
-        }
-        rate--;
+    /** Must be a power of two the hardware rate divides into */
+    if (passed_rate < 2 || passed_rate > MAX_RTC_RATE || (passed_rate & (passed_rate - 1))) {
+        return FAILURE;
     }
 
-    // Need to disable interrupts
-    rtc_running[current_process] = passed_rate;
-    rtc_virtual_interupt[current_process] = 0;
-    cli_and_save(flags);
-    outb(0x8A, CMOS_REG);
-    char exisiting = inb(RTC_REG);
-    outb(0x8A,CMOS_REG);
-    /** Send the rate to the RTC */
-    outb((exisiting & 0xF0) | rate, RTC_REG);
-
-    // Need to enable interrupts
-    restore_flags(flags);
+    spin_lock_irqsave(&pcb->fd_lock, flags);
+    valid = rtc_fd_valid(fd);
+    spin_unlock(&pcb->fd_lock);
+    if (!valid) {
+        irq_restore(flags);
+        return FAILURE;
+    }
+    spin_lock(&rtc_lock);
+    pcb->fd_table[fd].rtc_divider = RTC_HW_RATE / passed_rate;
+    pcb->fd_table[fd].rtc_next = rtc_irqs + RTC_HW_RATE / passed_rate;
+    spin_unlock_irqrestore(&rtc_lock, flags);
     return 0;
 }
@@ -5,11 +5,20 @@
 #include "lib.h"
 #include "filesystem_driver.h"
 
-#define MAX_RTC_RATE 32768
+#define RTC_HW_RATE         1024    // Fixed rate of the hardware RTC, in Hz.
+#define RTC_HW_RATE_BITS    6       // Rate select for RTC_HW_RATE: 32768 >> (6 - 1).
+#define MAX_RTC_RATE        RTC_HW_RATE
+#define RTC_DEFAULT_RATE    2       // Rate of a freshly opened rtc file.
+#define RTC_WAKE_NEVER      0x7FFFFFFF  // rtc_wake_at offset when no reader is waiting.
+#define RTC_REG_A           0x8A    // Register A, rate select, with NMIs off.
+#define RTC_REG_B           0x8B    // Register B, interrupt enables, with NMIs off.
+#define RTC_REG_C           0x0C    // Register C, read to acknowledge an interrupt.
+#define RTC_PIE             0x40    // Periodic interrupt enable in register B.
 
 extern int32_t rtc_open(const uint8_t * filename);
 extern int32_t rtc_close(int32_t fd);
 extern int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes);
 extern int32_t rtc_write(int32_t passed, const void* buf, int32_t nbytes);
+extern int32_t rtc_poll(int32_t fd);
 
 extern void rtc_optable();
@@ -0,0 +1,156 @@
+/* run_queue.c - Queue of processes waiting for the CPU.
+ * vim:ts=4 noexpandtab
+ */
+#include "run_queue.h"
+#include "process_control.h"
+#include "interrupts.h"
+
+/*
+ * run_queue_init(run_queue_t * queue, spinlock_t * lock)
+ *   DESCRIPTION: Empties a run queue.
+ *   INPUTS: run_queue_t * queue - the queue to initialize.
+ *           spinlock_t * lock - lock protecting it, and its PCBs' run links.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void run_queue_init(run_queue_t * queue, spinlock_t * lock)
+{
+    queue->head = RUN_QUEUE_EMPTY;
+    queue->tail = RUN_QUEUE_EMPTY;
+    queue->length = 0;
+    queue->lock = lock;
+    spin_lock_init(lock);
+}
+
+/*
+ * run_queue_push(run_queue_t * queue, int pid)
+ *   DESCRIPTION: Adds a process to the back of a run queue. A process that
+ *                is already queued stays where it is.
+ *   INPUTS: run_queue_t * queue - the queue to add to.
+ *           int pid - the process to add.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Notes the tick the process started waiting on.
+ */
+void run_queue_push(run_queue_t * queue, int pid)
+{
+    pcb_t * pcb = &control_blocks[pid];
+    int flags = 0;
+
+    spin_lock_irqsave(queue->lock, flags);
+    if (pcb->on_run_queue) {
+        spin_unlock_irqrestore(queue->lock, flags);
+        return;
+    }
+
+    pcb->run_next = RUN_QUEUE_EMPTY;
+    pcb->run_prev = queue->tail;
+    if (queue->tail == RUN_QUEUE_EMPTY) {
+        queue->head = pid;
+    } else {
+        control_blocks[queue->tail].run_next = pid;
+    }
+    queue->tail = pid;
+    queue->length++;
+
+    pcb->on_run_queue = 1;
+    pcb->queued_tick = tick_count;
+    spin_unlock_irqrestore(queue->lock, flags);
+}
+
+/*
+ * run_queue_unlink(run_queue_t * queue, int pid)
+ *   DESCRIPTION: Takes a queued process out of a run queue.
+ *   INPUTS: run_queue_t * queue - the queue holding the process.
+ *           int pid - the process to take out.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Adds the ticks the process spent queued to its
+ *                 ready_ticks. Called with the queue's lock held.
+ */
+static void run_queue_unlink(run_queue_t * queue, int pid)
+{
+    pcb_t * pcb = &control_blocks[pid];
+
+    if (pcb->run_prev == RUN_QUEUE_EMPTY) {
+        queue->head = pcb->run_next;
+    } else {
+        control_blocks[pcb->run_prev].run_next = pcb->run_next;
+    }
+    if (pcb->run_next == RUN_QUEUE_EMPTY) {
+        queue->tail = pcb->run_prev;
+    } else {
+        control_blocks[pcb->run_next].run_prev = pcb->run_prev;
+    }
+    queue->length--;
+
+    pcb->on_run_queue = 0;
+    pcb->ready_ticks += tick_count - pcb->queued_tick;
+}
+
+/*
+ * run_queue_remove(run_queue_t * queue, int pid)
+ *   DESCRIPTION: Takes a process out of a run queue, wherever it is.
+ *   INPUTS: run_queue_t * queue - the queue holding the process.
+ *           int pid - the process to take out.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: See run_queue_unlink.
+ */
+void run_queue_remove(run_queue_t * queue, int pid)
+{
+    int flags = 0;
+
+    spin_lock_irqsave(queue->lock, flags);
+    if (control_blocks[pid].on_run_queue) {
+        run_queue_unlink(queue, pid);
+    }
+    spin_unlock_irqrestore(queue->lock, flags);
+}
+
+/*
+ * run_queue_pop(run_queue_t * queue)
+ *   DESCRIPTION: Takes the process at the front of a run queue.
+ *   INPUTS: run_queue_t * queue - the queue to take from.
+ *   OUTPUTS: none
+ *   RETURN VALUE: The process ID, or RUN_QUEUE_EMPTY if the queue is empty.
+ *   SIDE EFFECTS: See run_queue_unlink.
+ */
+int run_queue_pop(run_queue_t * queue)
+{
+    int pid;
+    int flags = 0;
+
+    spin_lock_irqsave(queue->lock, flags);
+    pid = queue->head;
+    if (pid != RUN_QUEUE_EMPTY) {
+        run_queue_unlink(queue, pid);
+    }
+    spin_unlock_irqrestore(queue->lock, flags);
+    return pid;
+}
+
+/*
+ * run_queue_movable(run_queue_t * queue)
+ *   DESCRIPTION: Finds the first process on a run queue that another CPU
+ *                may take: one switched out without the kernel lock, so
+ *                its saved context does not belong to this CPU.
+ *   INPUTS: run_queue_t * queue - the queue to look in.
+ *   OUTPUTS: none
+ *   RETURN VALUE: The process ID, or RUN_QUEUE_EMPTY if there is none.
+ *   SIDE EFFECTS: Leaves the process queued; run_queue_remove takes it.
+ */
+int run_queue_movable(run_queue_t * queue)
+{
+    int pid;
+    int flags = 0;
+
+    spin_lock_irqsave(queue->lock, flags);
+    pid = queue->head;
+    while (pid != RUN_QUEUE_EMPTY && control_blocks[pid].sched_locked) {
+        pid = control_blocks[pid].run_next;
+    }
+    spin_unlock_irqrestore(queue->lock, flags);
+    return pid;
+}
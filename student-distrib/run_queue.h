@@ -0,0 +1,28 @@
+/* run_queue.h - Queue of processes waiting for the CPU.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#include "types.h"
+#include "lock.h"
+
+#define RUN_QUEUE_EMPTY     -1  // No process is queued.
+#define SCHED_LEVELS        3   // Scheduling priority levels, 0 is the highest.
+
+// Run Queue Structure. Queued processes are linked through their PCBs'
+// run_prev and run_next, so every operation is O(1).
+// Each CPU has one queue per priority level, and the scheduler takes from
+// the highest level that is not empty.
+typedef struct run_queue
+{
+    int head;
+    int tail;
+    int length;
+    spinlock_t * lock;      // The owning CPU's sched_lock, shared by its levels.
+} run_queue_t;
+
+extern void run_queue_init(run_queue_t * queue, spinlock_t * lock);
+extern void run_queue_push(run_queue_t * queue, int pid);
+extern int run_queue_pop(run_queue_t * queue);
+extern void run_queue_remove(run_queue_t * queue, int pid);
+extern int run_queue_movable(run_queue_t * queue);
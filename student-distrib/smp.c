@@ -0,0 +1,204 @@
+/* smp.c - Application processor startup and per-CPU scheduling state.
+ * vim:ts=4 noexpandtab
+ */
+#include "smp.h"
+#include "apic.h"
+#include "lib.h"
+#include "x86_desc.h"
+#include "clocksource.h"
+#include "interrupts.h"
+#include "syscalls.h"
+
+extern uint8_t ap_trampoline[];
+extern uint8_t ap_trampoline_end[];
+
+// Stacks for the APs. The boot CPU keeps the kernel's own.
+static uint32_t ap_stacks[MAX_CPUS][AP_STACK_WORDS];
+// Stack and cpus index of the AP being started, read by the AP itself.
+uint32_t ap_stack_top;
+static volatile int ap_booting;
+// Set by smp_sched_start once the APs may enter the scheduler.
+static volatile int ap_release;
+
+/*
+ * smp_delay_us(uint32_t us)
+ *   DESCRIPTION: Busy-waits on the TSC.
+ *   INPUTS: uint32_t us - microseconds to wait.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void smp_delay_us(uint32_t us)
+{
+    uint64_t end = clock_ns() + (uint64_t)us * 1000;
+
+    while (clock_ns() < end) {}
+}
+
+/*
+ * tss_init(int index)
+ *   DESCRIPTION: Sets up a CPU's TSS and its entry in the GDT, and loads the
+ *                CPU's task register with it. Run on the CPU itself. Each
+ *                CPU has its own so that each can have its own esp0.
+ *   INPUTS: int index - the CPU's cpus index.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: this_cpu() finds the CPU's entry from here on.
+ */
+void tss_init(int index)
+{
+    cpu_t * cpu = &cpus[index];
+    seg_desc_t the_tss_desc;
+
+    the_tss_desc.granularity   = 0x0;
+    the_tss_desc.opsize        = 0x0;
+    the_tss_desc.reserved      = 0x0;
+    the_tss_desc.avail         = 0x0;
+    the_tss_desc.seg_lim_19_16 = TSS_SIZE & 0x000F0000;
+    the_tss_desc.present       = 0x1;
+    the_tss_desc.dpl           = 0x0;
+    the_tss_desc.sys           = 0x0;
+    the_tss_desc.type          = 0x9;
+    the_tss_desc.seg_lim_15_00 = TSS_SIZE & 0x0000FFFF;
+
+    SET_TSS_PARAMS(the_tss_desc, &cpu->tss, TSS_SIZE - 1);
+
+    tss_desc_ptr[index] = the_tss_desc;
+
+    cpu->tss.ldt_segment_selector = KERNEL_LDT;
+    cpu->tss.ss0 = KERNEL_DS;
+    cpu->tss.esp0 = 0x800000;
+    ltr(KERNEL_TSS + index * sizeof(seg_desc_t));
+}
+
+/*
+ * ap_main()
+ *   DESCRIPTION: C entry of an AP, from smp_trampoline.S. Gives the CPU its
+ *                TSS and SYSENTER stack, marks it online and, once
+ *                smp_sched_start lets it, enters the scheduler.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: Only returns, to halt for good, when there is no local
+ *                 APIC timer to schedule by.
+ *   SIDE EFFECTS: none
+ */
+void ap_main()
+{
+    int index = ap_booting;
+
+    lidt(idt_desc_ptr);
+    tss_init(index);
+    sysenter_init();
+    cpus[index].online = 1;
+
+    while (!ap_release) {
+        asm volatile ("pause");
+    }
+    if (!apic_irqs) {
+        return;
+    }
+    sched_ap_start();
+}
+
+/*
+ * smp_start_ap(int index)
+ *   DESCRIPTION: Starts one AP with the INIT, startup, startup IPI
+ *                sequence and waits for it to come online.
+ *   INPUTS: int index - its cpus index.
+ *   OUTPUTS: none
+ *   RETURN VALUE: SUCCESS if it came online, FAILURE if not.
+ *   SIDE EFFECTS: none
+ */
+static int smp_start_ap(int index)
+{
+    uint32_t apic_id = cpus[index].apic_id;
+    uint32_t start;
+
+    ap_booting = index;
+    ap_stack_top = (uint32_t)&ap_stacks[index][AP_STACK_WORDS];
+
+    lapic_send_ipi(apic_id, ICR_INIT | ICR_ASSERT);
+    smp_delay_us(AP_INIT_DELAY_US);
+    lapic_send_ipi(apic_id, ICR_STARTUP | (AP_TRAMPOLINE >> 12));
+    smp_delay_us(AP_SIPI_DELAY_US);
+    if (!cpus[index].online) {
+        lapic_send_ipi(apic_id, ICR_STARTUP | (AP_TRAMPOLINE >> 12));
+    }
+
+    start = clock_ms();
+    while (!cpus[index].online) {
+        if (clock_ms() - start > AP_START_TIMEOUT_MS) {
+            return FAILURE;
+        }
+    }
+    return SUCCESS;
+}
+
+/*
+ * smp_init()
+ *   DESCRIPTION: Finds the processors in the MADT, maps the local APICs and
+ *                starts every AP. Without a MADT the kernel stays on the
+ *                boot CPU alone.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Overwrites the page at AP_TRAMPOLINE. Must run after
+ *                 paging_init and clocksource_init, with interrupts off.
+ */
+void smp_init()
+{
+    uint32_t bsp_id;
+    uint8_t * trampoline;
+    int i;
+    int next;
+
+    acpi_init();
+    apic_map();
+
+    cpus_online = 1;
+    sched_cpus = 1;
+    cpus[0].online = 1;
+    if (lapic == NULL) {
+        cpus[0].apic_id = 0;
+        return;
+    }
+    bsp_id = lapic_id();
+    cpus[0].apic_id = bsp_id;
+
+    trampoline = early_map(AP_TRAMPOLINE);
+    memcpy(trampoline, ap_trampoline, ap_trampoline_end - ap_trampoline);
+    early_unmap();
+
+    // The boot CPU is cpus[0]; the rest follow in MADT order.
+    next = 1;
+    for (i = 0; i < num_cpus; i++) {
+        if (cpu_apic_ids[i] == bsp_id) {
+            continue;
+        }
+        cpus[next].apic_id = cpu_apic_ids[i];
+        cpus[next].online = 0;
+        if (smp_start_ap(next) == SUCCESS) {
+            next++;
+            cpus_online++;
+        }
+    }
+}
+
+/*
+ * smp_sched_start()
+ *   DESCRIPTION: Lets the APs into the scheduler. The boot CPU calls this
+ *                once the process control blocks and its own local APIC
+ *                timer are set up. Without the local APIC timer, the APs
+ *                have nothing to schedule by and halt.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Sets sched_cpus to every CPU online.
+ */
+void smp_sched_start()
+{
+    if (apic_irqs) {
+        sched_cpus = cpus_online;
+    }
+    ap_release = 1;
+}
@@ -0,0 +1,81 @@
+/* smp.h - Application processor startup and per-CPU scheduling state.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#define AP_TRAMPOLINE       0x8000      // Physical page the APs start in, real mode.
+#define AP_STACK_WORDS      1024        // Words in each AP's kernel stack.
+#define AP_START_TIMEOUT_MS 100         // Time an AP gets to come online.
+#define AP_INIT_DELAY_US    10000       // Wait after the INIT IPI.
+#define AP_SIPI_DELAY_US    200         // Wait after each startup IPI.
+#define CR4_PSE             0x00000010
+#define CR4_PGE             0x00000080
+#define CR0_PE              0x00000001
+#define CR0_PG              0x80000000
+
+#ifndef ASM
+
+#include "acpi.h"
+#include "x86_desc.h"
+#include "run_queue.h"
+#include "lock.h"
+
+// Per-CPU Data. Index 0 is the boot CPU. Each CPU runs its own processes
+// off its own run queues, with its own TSS so that interrupts from user
+// mode land on the kernel stack of the process it is running. A process
+// preempted in user mode may be taken by an idle CPU; see timer_handler.
+typedef struct cpu
+{
+    uint32_t apic_id;
+    volatile int online;
+    tss_t tss;                  // esp0 is the kernel stack of current_pid.
+    int pid;                    // Process running here, current_pid.
+    int process;                // Its terminal, current_process.
+    char * video;               // Where this CPU's prints go, video_mem.
+    run_queue_t run_queues[SCHED_LEVELS];   // Processes waiting for this CPU.
+    spinlock_t sched_lock;      // Protects run_queues and their PCBs' run links.
+    volatile int yield_request; // Set while a process gives up its time slice early.
+    volatile int kicked;        // Sent a scheduling IPI it has not taken yet.
+    int idle_running;           // Set while the idle context has the CPU.
+    int idle_esp;               // Saved stack pointer of the idle context.
+    uint32_t idle_since;        // TSC when the idle context last took the CPU.
+    uint32_t idle_ticks;        // Timer ticks that landed in the idle context.
+    uint32_t idle_cycles;       // Cycles spent in the idle context.
+    uint32_t ticks_seen;        // tick_count when this CPU last charged ticks.
+} cpu_t;
+
+cpu_t cpus[MAX_CPUS];
+int cpus_online;            // CPUs running, the boot CPU included.
+int sched_cpus;             // CPUs that run processes, the first ones in cpus.
+
+/*
+ * this_cpu()
+ *   DESCRIPTION: Finds the per-CPU data of the CPU running this, from the
+ *                TSS selector in its task register.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: The CPU's cpus entry. The boot CPU's before tss_init.
+ *   SIDE EFFECTS: none
+ */
+static inline cpu_t * this_cpu()
+{
+    uint16_t selector;
+
+    asm volatile ("str %0" : "=r"(selector));
+    if (selector < KERNEL_TSS) {
+        return &cpus[0];
+    }
+    return &cpus[(selector - KERNEL_TSS) >> 3];
+}
+
+// The running process, its terminal and the screen the kernel prints to
+// differ from CPU to CPU.
+#define current_pid         (this_cpu()->pid)
+#define current_process     (this_cpu()->process)
+#define video_mem           (this_cpu()->video)
+
+extern void tss_init(int index);
+extern void smp_init();
+extern void smp_sched_start();
+
+#endif /* ASM */
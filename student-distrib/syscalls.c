@@ -7,6 +7,8 @@
 #include "interrupts.h"
 #include "x86_desc.h"
 #include "process_control.h"
+#include "clocksource.h"
+#include "syscalls_wrapper.h"
 
 
 extern void init_control_registers_paging(int * ptr);
@@ -63,6 +65,29 @@ int do_call(int call, int arg0, int arg1, int arg2)
     return ret;
 }
 
+/*
+ * sysenter_init
+ *   DESCRIPTION: Points SYSENTER at sysenter_entry, when the CPU has it.
+ *                User programs check CPUID themselves and fall back to
+ *                INT 0x80 without it.
+ *   INPUTS: None
+ *   OUTPUTS: None
+ *   RETURN VALUE: None
+ *   SIDE EFFECTS: Writes the SYSENTER MSRs of the CPU running it, which
+ *                 every CPU does for itself after tss_init. The stack MSR
+ *                 points at the esp0 of the CPU's own TSS, which
+ *                 sysenter_entry loads before using the stack.
+ */
+void sysenter_init()
+{
+	if (!(cpuid_edx(CPUID_FEATURES) & CPUID_SEP)) {
+		return;
+	}
+	wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+	wrmsr(MSR_SYSENTER_ESP, (uint32_t)&this_cpu()->tss.esp0);
+	wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+}
+
 /*
  * halt
  *   DESCRIPTION: Halts the current process.
@@ -77,15 +102,24 @@ int32_t halt(uint8_t status)
 	cli();
 	int parent_pid = control_blocks[current_pid].parent;
 	past_pid = current_pid;
+	// Close the child's files while it is still current.
+	for(i = 2; i < FDT_SIZE; i++){
+		pcb_close(i);
+	}
+	cli();
 	// Restore Parent PCB
 	destroy_pcb(current_pid);
     current_pid = parent_pid;
-    tss.esp0 = control_blocks[current_pid].esp;
-for(i = 2; i < FDT_SIZE; i++){
-    pcb_close(i);
-  }
-	process_pages[VIRTUAL_PROGRAM] = (M_4*(current_pid + 1)) | PAGE_ARGS;
-	flush_tlb();
+    // The parent resumes below HALTED on this CPU, whichever it was on.
+    control_blocks[current_pid].cpu = this_cpu() - cpus;
+    this_cpu()->tss.esp0 = control_blocks[current_pid].esp;
+	// Drop the child's file mappings and frames and switch back to the parent's pages.
+	last_page_faults = control_blocks[past_pid].page_faults;
+	last_run_ticks = control_blocks[past_pid].run_ticks;
+	last_ready_ticks = control_blocks[past_pid].ready_ticks;
+	clear_mmap_pages(past_pid);
+	free_program_pages(past_pid);
+	load_page_directory(current_pid);
 	// Move status into EAX.
 	__asm__("xorl %%eax, %%eax;"
 			"movb %0, %%al;"
@@ -124,8 +158,8 @@ void schedule()
  *   INPUTS:
  *   OUTPUTS: none
  *   RETURN VALUE:
- *   SIDE EFFECTS: Resets current context's top ebp and esp, as well as
- *                 decreases the current process
+ *   SIDE EFFECTS: Pops the halted process off its terminal's foreground
+ *                 chain. Scheduling itself goes through the run queue.
  */
 
 void deschedule()
@@ -133,8 +167,6 @@ void deschedule()
 	// Clear all schedule structs associated with this process.
 	int top = schedule_top[current_process] - 1;
 	schedule_stack[current_process][top] = 0;
-	schedule_ebp[current_process][top] = 0;
-	schedule_esp[current_process][top] = 0;
 	schedule_top[current_process]--;
 }
 
@@ -150,17 +182,21 @@ void deschedule()
 int32_t execute(const uint8_t *command)
 {
 	/* Initialize vars */
+	uint32_t start_cycles = rdtsc();
 	int execute_return = 0;
 	int temp = 0;
-	int fd = 0;
 	uint32_t entry = 0;
     int i = 0;
 	int magic = 0;
-	/* 10000 is an arbitrarily large buffer*/
-    int buf[10000];
-    int length = 10000;
+	int respawn = 0;
+	dir_entry_t dentry;
+	uint32_t inode;
+	uint32_t length;
     uint8_t cmd[EXEC_BUFFER_SIZE] = {0};
-    int addr;
+
+	// Switching page directories, stacks and the TSS must not be preempted.
+	// Interrupts come back on once the parent resumes below HALTED.
+	cli();
 
 	// null check.
     if (command == NULL) {
@@ -192,29 +228,41 @@ int32_t execute(const uint8_t *command)
 	cmd[i] = '\0';
   // Save i for passing args later.
 
-	// Attempt to open the cmd
-	fd = open(cmd);
-	if (fd == FAILURE) {
+	// Look up the cmd; only regular files that fit in the program page can run.
+	if (read_dentry_by_name(cmd, &dentry) == FAILURE || dentry.file_type != TYPE_FILE) {
+		return FAILURE;
+	}
+	inode = dentry.inode_num;
+	length = node_list[inode].B_length;
+	if (length < sizeof(magic) || length > MAX_PROGRAM_SIZE) {
 		return FAILURE;
 	}
 
-	/*Read the contents into buf*/
-	read(fd, buf, length);
-	close(fd);
-
-	/*copy the first four bytes of the buf into magic*/
-	memcpy(&magic,buf,4);
+	/*read the first four bytes of the file into magic*/
+	if (read_data(inode, 0, (uint8_t *)&magic, sizeof(magic)) != sizeof(magic)) {
+		return FAILURE;
+	}
 
 	/*if magic is not the magic leading numbers, fail*/
 	if (magic != MAGIC_LEAD) {
 		return FAILURE;
 	}
 
+	/*The user stack page is mapped up front, so a frame must be free*/
+	if (free_frames == 0) {
+		return FAILURE;
+	}
+
+	// A new terminal's first shell may be started from inside the idle context.
+	idle_abandon();
+
 	// Set up new page
 	current_pid = create_new_pcb(current_pid);
 	control_blocks[current_pid].stack_pos = temp;
 
-	if (0 == strncmp((int8_t *)cmd, (int8_t *)"shell", strlen("shell")))
+	// Remember the terminal's base shell so it can be restarted when it exits.
+	if (control_blocks[current_pid].parent == SENTINEL_PROCESS &&
+		0 == strncmp((int8_t *)cmd, (int8_t *)"shell", strlen("shell")))
 	{
 		if (strlen((int8_t *)cmd) == strlen((int8_t *)"shell"))
 		{
@@ -225,11 +273,11 @@ int32_t execute(const uint8_t *command)
 	/*Calculate the espo by taking the kernel address and adding
 	 * the 4 mb offset and subtracting 15 and then subtract from there
 	 * 8 kilobytes times the current pid*/
-	tss.esp0 = KERNEL_ADDR + (M_4 - 0xF) - (2 * K_4 * current_pid);
-	tss.ss0 = KERNEL_DS;
+	this_cpu()->tss.esp0 = KERNEL_ADDR + (M_4 - 0xF) - (2 * K_4 * current_pid);
+	this_cpu()->tss.ss0 = KERNEL_DS;
 
 	/*Load the new pcv with the new ss0 and esp0*/
-	load_pcb(current_pid, KERNEL_DS, tss.esp0);
+	load_pcb(current_pid, KERNEL_DS, this_cpu()->tss.esp0);
 	  // Move args.
     // Remove leading spaces.
     while (command[i] == ' ')
@@ -246,63 +294,49 @@ int32_t execute(const uint8_t *command)
             (const int8_t *)&command[i], (uint32_t)strlen((const int8_t *)&command[i]));
     }
 
-    // intializes paging and don't need to do anything for 8Mb to 4Gb
-    // intializes first table in mem
-	i = 0;
-	for (i = 0; i < PAGE_SIZE; i++)
-    {
-		process_pages[i] = READWRITE_MASK;
-		process_tables[i] =  READWRITE_MASK;
-	}
-
-    // maps the kernel, sets it to present
-	process_pages[1] = KERNEL_USER;
+	/*Map the program region with 4kB pages backed by frames from the frame
+	 * allocator. Pages are filled in from the image on first touch*/
+	init_program_pages(current_pid, inode, length);
 
-	process_tables[VIDEOMEM] = VIDEO | READWRITE_MASK | PRESENT_MASK;
-
-	process_tables[0xB9] = VIDEO_1 | USER_MASK | READWRITE_MASK | PRESENT_MASK;
-
-	process_tables[0xBA] = (VIDEO_1 + 0x1000) | USER_MASK | READWRITE_MASK | PRESENT_MASK;
-
-	process_tables[0xBB] = (VIDEO_1 + (0x1000 * 2)) | USER_MASK | READWRITE_MASK | PRESENT_MASK;
-	// sets up first table in the directory
-	process_pages[0] = ((unsigned int)process_tables) | USER_MASK | READWRITE_MASK | PRESENT_MASK;
-
-	/*Set the location of the process to the location of the pid+ 1 times the size of the
-	 * kernel*/
-	process_pages[VIRTUAL_PROGRAM] = (M_4*(current_pid + 1)) | PAGE_ARGS;
-
-    /*Create table entry for video mem*/
-	process_tables[VID_IDX] = (VIDEO) | USER_MASK | READWRITE_MASK | PRESENT_MASK;
-	addr = (int)&process_tables[VID_IDX];
-	process_pages[VID_IDX] = ((addr >> 12) << 12) | 0x7;
+	/*Build the process's own page directory, with VIDMAP going through
+	 * the table of the terminal it runs on*/
+	control_blocks[current_pid].terminal = current_terminal;
+	init_page_directory(current_pid);
 	// clear keyboard driver data.
 	clear_keyboard_buffer();
 	clear_history_buffer(current_pid);
 
 	/*Init paging to have the new page directory*/
-	flush_tlb();
+	load_page_directory(current_pid);
+	/*Back the top of the user stack now; the frame was checked for above*/
+	map_program_page(current_pid, STACK_PAGE_IDX);
 	video_mem = (char *)VIDMAP;
-	/*Copy the program from the buffer and into the virtual mem*/
-	memcpy((void*)(VIRTUAL_START), buf, length); // 128MB VM
-
-	/*Get the entry point of the executable, it is four bytes in size
-	 * so we copy the four bytes*/
-	memcpy((void*)&entry, (const void*) ENTRY_START, 4);
+	/*Get the entry point of the executable straight from the file, it is
+	 * four bytes in size so we read the four bytes*/
+	read_data(inode, ENTRY_START - VIRTUAL_START, (uint8_t *)&entry, sizeof(entry));
 
 	if (terminal_running[current_terminal] == 0) {
 		terminal_running[current_terminal] = 1;
 	}
 
 	schedule();
+	// The program's own first instructions fault in its pages; see
+	// exec_first_event for where that part of the latency ends.
+	control_blocks[current_pid].exec_start = start_cycles;
+	exec_latency_cycles = rdtsc() - start_cycles;
+	// The program runs in user mode, where no CPU holds the kernel lock for it.
+	unlock_kernel(1);
 	__asm__("movl %0, %%ds"
             :
             : "r" (USER_DS)
             );
 
+	// User code runs with interrupts on, so the timer can preempt it and
+	// an idle CPU can take it over.
 	__asm__("pushl %0;"
             "pushl %1;"
 			"pushf;"
+			"orl $0x200, (%%esp);"
 			"pushl %2;"
 			"pushl %3;"
             :
@@ -323,13 +357,14 @@ int32_t execute(const uint8_t *command)
 			: "r" (temp)
             );
 
+	respawn = (current_pid == SENTINEL_PROCESS && past_pid == shell_pid[current_process]);
 	deschedule();
 
 
 	sti();
 
 
-	if (current_pid == SENTINEL_PROCESS) {
+	if (respawn) {
 		do_call(SYS_EXECUTE, (int) "shell", 0, 0);
 	}
 
@@ -337,6 +372,51 @@ int32_t execute(const uint8_t *command)
 }
 
 
+/*
+ * fd_ops
+ *   DESCRIPTION: Looks up the operations of an open file of the current
+ *                process, under its fd_lock.
+ *   INPUTS: fd - file table idx
+ *   OUTPUTS: None
+ *   RETURN VALUE: the file's operations, NULL if fd is not open
+ *   SIDE EFFECTS: none
+ */
+static optable_t * fd_ops(int32_t fd)
+{
+	pcb_t * pcb = &control_blocks[current_pid];
+	optable_t * ops = NULL;
+	int flags = 0;
+
+	if (fd < 0 || fd >= FDT_SIZE) {
+		return NULL;
+	}
+	spin_lock_irqsave(&pcb->fd_lock, flags);
+	if (pcb->fd_table[fd].flags != -1) {
+		ops = pcb->fd_table[fd].file_operations_pointer;
+	}
+	spin_unlock_irqrestore(&pcb->fd_lock, flags);
+	return ops;
+}
+
+/*
+ * exec_first_event
+ *   DESCRIPTION: Called on every page fault and system call of a process.
+ *                The first one after execute stops exec_first_cycles, which
+ *                unlike exec_latency_cycles includes the demand-paging fault
+ *                the program takes as it starts.
+ *   INPUTS: pid - the faulting or calling process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Clears the process's exec_start.
+ */
+void exec_first_event(int pid)
+{
+	if (control_blocks[pid].exec_start != 0) {
+		exec_first_cycles = rdtsc() - control_blocks[pid].exec_start;
+		control_blocks[pid].exec_start = 0;
+	}
+}
+
 /*
  * read
  *   DESCRIPTION: Calls the correct read function based on file type
@@ -349,23 +429,17 @@ int32_t execute(const uint8_t *command)
  */
 int32_t read(int32_t fd, void *buf, int32_t nbytes)
 {
+	optable_t * ops;
+
 	/* NULL check */
-	cli();
 	if (buf == NULL) {
 		return -1;
 	}
-
-	if (fd < 0 || fd >= FDT_SIZE) {
-		return -1;
-	}
-
-	if (control_blocks[current_pid].fd_table[fd].flags == -1) {
+	ops = fd_ops(fd);
+	if (ops == NULL) {
 		return -1;
 	}
-    if(control_blocks[current_pid].fd_table[fd].file_operations_pointer == NULL){
-        return -1;
-    }
-	return control_blocks[current_pid].fd_table[fd].file_operations_pointer->read(fd, buf, nbytes);
+	return ops->read(fd, buf, nbytes);
 }
 
 /*
@@ -380,22 +454,16 @@ int32_t read(int32_t fd, void *buf, int32_t nbytes)
  */
 int32_t write(int32_t fd, const void *buf, int32_t nbytes)
 {
-    // sti();
-	cli();
-	if (buf == NULL) {
-		return -1;
-    }
-	if (fd < 0 || fd >= FDT_SIZE) {
-		return -1;
-	}
+	optable_t * ops;
 
-	if (control_blocks[current_pid].fd_table[fd].flags == -1) {
+	if (buf == NULL) {
 		return -1;
 	}
-	if (control_blocks[current_pid].fd_table[fd].file_operations_pointer == NULL) {
+	ops = fd_ops(fd);
+	if (ops == NULL) {
 		return -1;
 	}
-    return control_blocks[current_pid].fd_table[fd].file_operations_pointer->write(fd, buf, nbytes);
+	return ops->write(fd, buf, nbytes);
 }
 
 /*
@@ -414,7 +482,6 @@ int32_t open(const uint8_t *filename)
   int ret;
 	dir_entry_t dentry; // used to store inodes in pcb
 	int file_type;
-  cli();
   if(filename == NULL){
     return -1;
   }
@@ -450,15 +517,56 @@ int32_t open(const uint8_t *filename)
  */
 int32_t close(int32_t fd)
 {
-	cli();
+	optable_t * ops;
+
   	// Reject closing stdin and stdout
-    if (fd < 2 || fd >= FDT_SIZE) {
-      return -1;
-    }
-    if (control_blocks[current_pid].fd_table[fd].file_operations_pointer == NULL) {
+    if (fd < 2) {
       return -1;
     }
-    return control_blocks[current_pid].fd_table[fd].file_operations_pointer->close(fd);
+	ops = fd_ops(fd);
+	if (ops == NULL) {
+		return -1;
+	}
+	return ops->close(fd);
+}
+
+/*
+ * fcntl
+ *   DESCRIPTION: Reads or sets the O_NONBLOCK flag of an open file. Reads of
+ *                a directory never block, and its flags hold the entries
+ *                left to read, so there the flag is always clear.
+ *   INPUTS: fd - file table idx
+ *           cmd - F_GETFL or F_SETFL
+ *           arg - for F_SETFL, the new flags; only O_NONBLOCK is kept
+ *   OUTPUTS: none
+ *   RETURN VALUE: F_GETFL: the flags; F_SETFL: 0. -1 if fd is not open or
+ *                 cmd is unknown.
+ *   SIDE EFFECTS: changes how read on fd behaves when it would block
+ */
+int32_t fcntl(int32_t fd, int32_t cmd, int32_t arg)
+{
+	pcb_t * pcb = &control_blocks[current_pid];
+	fd_block_t * fblock;
+	int32_t ret = -1;
+	int flags = 0;
+
+	if (fd < 0 || fd >= FDT_SIZE) {
+		return -1;
+	}
+	spin_lock_irqsave(&pcb->fd_lock, flags);
+	fblock = &pcb->fd_table[fd];
+	if (fblock->flags != -1 && fblock->file_operations_pointer != NULL) {
+		if (cmd == F_GETFL) {
+			ret = (fblock->file_operations_pointer == dir) ? 0 : (fblock->flags & O_NONBLOCK);
+		} else if (cmd == F_SETFL) {
+			if (fblock->file_operations_pointer != dir) {
+				fblock->flags = (fblock->flags & ~O_NONBLOCK) | (arg & O_NONBLOCK);
+			}
+			ret = 0;
+		}
+	}
+	spin_unlock_irqrestore(&pcb->fd_lock, flags);
+	return ret;
 }
 
 /*
@@ -474,7 +582,6 @@ int32_t close(int32_t fd)
 int32_t getargs(void *buf, int32_t nbytes)
 {
 	/* NULL check */
-	cli();
 	if (buf == NULL) {
 		return -1;
 	}
@@ -509,8 +616,6 @@ int32_t getargs(void *buf, int32_t nbytes)
  */
 int32_t vidmap(uint8_t **screen_start)
 {
-	cli();
-    // sti();
     if (screen_start == NULL) {
       return -1;
     }
@@ -537,7 +642,6 @@ int32_t vidmap(uint8_t **screen_start)
  */
 int32_t set_handler(int32_t signum, void *handler_address)
 {
-	  cli();
     if(handler_address == NULL) {
 		return -1;
 	}
@@ -555,19 +659,156 @@ int32_t set_handler(int32_t signum, void *handler_address)
  */
 int32_t sigreturn(void)
 {
-	  cli();
     return -1;
 }
+/*
+ * mmap
+ *   DESCRIPTION: Maps the data of an open file read-only into the process's
+ *                mmap region, one 4kB page per data block, so the file can be
+ *                scanned in place instead of copied out with read.
+ *   INPUTS: fd - file table idx of an open regular file
+ *           start - where to store the user address of the first byte
+ *   OUTPUTS: *start is set to the start of the mapping
+ *   RETURN VALUE: length of the file in bytes on success, -1 on failure
+ *   SIDE EFFECTS: fills entries of the process's mmap page table. The
+ *                 mappings stay until the process halts.
+ */
+int32_t mmap(int32_t fd, uint8_t **start)
+{
+	uint32_t inode;
+	uint32_t length;
+	uint32_t num_pages;
+	uint32_t i;
+	uint8_t * block;
+	int first;
+
+	if (fd < 2 || fd >= FDT_SIZE) {
+		return -1;
+	}
+	if (control_blocks[current_pid].fd_table[fd].file_operations_pointer != file) {
+		return -1;
+	}
+	if ((uint32_t)start < USER_PAGE_START || (uint32_t)start > USER_PAGE_START + M_4 - sizeof(*start)) {
+		return -1;
+	}
+
+	inode = control_blocks[current_pid].fd_table[fd].inode;
+	length = node_list[inode].B_length;
+	num_pages = (length + FILE_SIZE - 1) / FILE_SIZE;
+	first = control_blocks[current_pid].mmap_pages;
+	if (first + num_pages > PAGE_SIZE) {
+		return -1;
+	}
+
+	// One read-only user PTE per data block, in file order.
+	for (i = 0; i < num_pages; i++)
+	{
+		block = fetch_data_block(inode, i);
+		if (block == NULL) {
+			return -1;
+		}
+		mmap_tables[current_pid][first + i] = (uint32_t)block | USER_MASK | PRESENT_MASK;
+	}
+	control_blocks[current_pid].mmap_pages = first + num_pages;
+
+	load_mmap_pages(current_pid);
+	for (i = 0; i < num_pages; i++)
+	{
+		invlpg(MMAP_START + ((first + i) << PTE_SHIFT));
+	}
+
+	*start = (uint8_t *)(MMAP_START + (first << PTE_SHIFT));
+	return length;
+}
+
+/*
+ * sleep_timer_expired
+ *   DESCRIPTION: Timer function for sleep and nanosleep. Wakes the sleeper.
+ *   INPUTS: pid - the sleeping process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: puts the process back on the run queue
+ */
+static void sleep_timer_expired(int pid)
+{
+	wait_queue_wake(&control_blocks[pid].sleep_queue);
+}
+
+/*
+ * sleep_ticks
+ *   DESCRIPTION: Blocks the current process for at least the given number of
+ *                whole timer ticks. The count starts at the next tick
+ *                boundary, so a partly gone tick is never counted.
+ *   INPUTS: ticks - ticks to sleep
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: arms the process's sleep timer and gives up the CPU
+ */
+static void sleep_ticks(uint32_t ticks)
+{
+	pcb_t * pcb = &control_blocks[current_pid];
+	uint32_t target;
+
+	cli();
+	target = tick_count + clock_peek_ticks() + ticks + 1;
+	timer_init(&pcb->sleep_timer, sleep_timer_expired, current_pid);
+	while ((int32_t)(target - tick_count) > 0) {
+		timer_add(&pcb->sleep_timer, target);
+		wait_queue_sleep(&pcb->sleep_queue);
+	}
+	timer_cancel(&pcb->sleep_timer);
+}
+
+/*
+ * sleep
+ *   DESCRIPTION: Blocks the calling process for a number of seconds. Other
+ *                processes run in the meantime.
+ *   INPUTS: seconds - time to sleep
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0
+ *   SIDE EFFECTS: gives up the CPU until the time has passed
+ */
+int32_t sleep(uint32_t seconds)
+{
+	sleep_ticks(ns_to_ticks((uint64_t)seconds * NS_PER_SECOND));
+	return 0;
+}
+
+/*
+ * nanosleep
+ *   DESCRIPTION: Blocks the calling process for the time in req, rounded up
+ *                to whole timer ticks.
+ *   INPUTS: req - user pointer to the time to sleep
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on a bad pointer or tv_nsec out of range
+ *   SIDE EFFECTS: gives up the CPU until the time has passed
+ */
+int32_t nanosleep(const timespec_t * req)
+{
+	if ((uint32_t)req < USER_PAGE_START || (uint32_t)req > USER_PAGE_START + M_4 - sizeof(*req)) {
+		return -1;
+	}
+	if (req->tv_nsec >= NS_PER_SECOND) {
+		return -1;
+	}
+
+	sleep_ticks(ns_to_ticks((uint64_t)req->tv_sec * NS_PER_SECOND + req->tv_nsec));
+	return 0;
+}
+
 /*
  * pcb_close
- *   DESCRIPTION: closes a file in the current pcb
+ *   DESCRIPTION: closes a file in the current pcb, if it is open
  *   INPUTS: fd - file to close
- *
  *   OUTPUTS: none
  *   RETURN VALUE: NONE
- *   SIDE EFFECTS: closes a given fd file
+ *   SIDE EFFECTS: closes a given fd file, so an open rtc is released
  */
 void pcb_close(int fd){
-  //TODO: Finish function
-  return;
+	optable_t * ops = control_blocks[current_pid].fd_table[fd].file_operations_pointer;
+
+	if (control_blocks[current_pid].fd_table[fd].flags == -1 || ops == NULL) {
+		return;
+	}
+	ops->close(fd);
 }
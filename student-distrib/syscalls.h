@@ -8,26 +8,18 @@
 #include "lib.h"
 #include "filesystem_driver.h"
 #include "process_control.h"
+#include "sysnum.h"
 
 #define TYPE_RTC 0
 #define TYPE_DIR 1
 #define TYPE_FILE 2
 
-#define SYS_HALT        1
-#define SYS_EXECUTE     2
-#define SYS_READ        3
-#define SYS_WRITE       4
-#define SYS_OPEN        5
-#define SYS_CLOSE       6
-#define SYS_GETARGS     7
-#define SYS_VIDMAP      8
-#define SYS_SET_HANDLER 9
-#define SYS_SIGRETURN   10
-
+#define USER_PAGE_START 0x8000000
 #define VIRTUAL_START 0x8048000
 #define ENTRY_START 0x8048018
 #define STACK_LOCATION 0x83FFFF0
 #define MAGIC_LEAD 0x464c457f
+#define MAX_PROGRAM_SIZE 0x3B7000 // Program page space from VIRTUAL_START up, less the user stack page.
 #define VIRTUAL_PROGRAM 32
 #define PAGE_ARGS 0x87
 
@@ -38,23 +30,37 @@
 
 #define VID_IDX 33
 
+#define NS_PER_SECOND 1000000000
+#define CPUID_FEATURES 1
+#define CPUID_SEP (1 << 11) // SYSENTER and SYSEXIT, in CPUID leaf 1 EDX.
+
+// Timespec Structure. Time for nanosleep, tv_nsec below NS_PER_SECOND.
+typedef struct timespec
+{
+    uint32_t tv_sec;
+    uint32_t tv_nsec;
+} timespec_t;
+
 extern int do_call(int call, int arg0, int arg1, int arg2);
 extern int handle_system_calls();
+extern void sysenter_init();
+extern void exec_first_event(int pid);
 extern int32_t close(int32_t fd);
 extern int32_t open(const uint8_t *filename);
 extern int32_t write(int32_t fd, const void *buf, int32_t nbytes);
 extern int32_t read(int32_t fd, void *buf, int32_t nbytes);
 extern void pcb_close(int fd);
+extern int32_t sleep(uint32_t seconds);
+extern int32_t nanosleep(const timespec_t * req);
+extern int32_t fcntl(int32_t fd, int32_t cmd, int32_t arg);
 
 #define NUM_TERMINALS   3 // Should be in terminal.h
-#define TOTAL_PROCESSES 7 // Should be in process_control.h
+#define TOTAL_PROCESSES 33 // Should be in process_control.h
 
 int shell_pid[NUM_TERMINALS];
+uint32_t exec_latency_cycles;                           // Cycles from the last execute entry to its iret.
+uint32_t exec_first_cycles;                             // Cycles from the last execute entry to the program's first page fault or system call.
 int working_pid[NUM_TERMINALS];
 int schedule_top[NUM_TERMINALS];                        // Holds the index of the top of each terminal's schedule stack
-uint8_t schedule_stack[NUM_TERMINALS][TOTAL_PROCESSES]; // Holds the processes present within a terminal.
-tss_t schedule_tss[NUM_TERMINALS][TOTAL_PROCESSES];     // Holds the tast state segment per process per terminal.
-int schedule_eip[NUM_TERMINALS][TOTAL_PROCESSES];       // Holds the Instruction Pointer per process per terminal.
-int schedule_esp[NUM_TERMINALS][TOTAL_PROCESSES];       // Holds the stack pointer per process per terminal.
-int schedule_ebp[NUM_TERMINALS][TOTAL_PROCESSES];       // Holds the stack pointer per process per terminal.
+uint8_t schedule_stack[NUM_TERMINALS][TOTAL_PROCESSES]; // Holds the foreground process chain of each terminal.
 #endif
@@ -9,5 +9,6 @@
 #include "syscalls.h"
 
 extern int32_t system_call();
+extern void sysenter_entry();
 
 #endif
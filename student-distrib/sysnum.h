@@ -0,0 +1,28 @@
+/* sysnum.h - System call numbers.
+ * vim:ts=4 noexpandtab
+ *
+ * Shared by the C handlers and syscalls_wrapper.S, so it holds defines only.
+ */
+#pragma once
+
+#define SYS_HALT        1
+#define SYS_EXECUTE     2
+#define SYS_READ        3
+#define SYS_WRITE       4
+#define SYS_OPEN        5
+#define SYS_CLOSE       6
+#define SYS_GETARGS     7
+#define SYS_VIDMAP      8
+#define SYS_SET_HANDLER 9
+#define SYS_SIGRETURN   10
+#define SYS_MMAP        11
+#define SYS_SLEEP       12
+#define SYS_NANOSLEEP   13
+#define SYS_RING_SETUP  14
+#define SYS_RING_ENTER  15
+#define SYS_SYSSTAT     16
+#define SYS_FCNTL       17
+#define SYS_POLL        18
+
+// Entries in syscalltable. Calls are numbered from 1, so this is the last one.
+#define NUM_SYSCALLS    SYS_POLL
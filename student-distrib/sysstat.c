@@ -0,0 +1,117 @@
+/* sysstat.c - Per-process system call counters and latency histograms.
+ * vim:ts=4 noexpandtab
+ */
+#include "sysstat.h"
+#include "syscalls.h"
+#include "process_control.h"
+#include "lock.h"
+
+// The handlers, in system call number order, less one. In syscalls_wrapper.S.
+extern int32_t (*syscalltable[NUM_SYSCALLS])(int32_t arg0, int32_t arg1, int32_t arg2);
+
+/*
+ * syscall_record(syscall_stat_t * stat, int32_t ret, uint64_t cycles)
+ *   DESCRIPTION: Adds the result and duration of a finished call to a
+ *                system call's statistics.
+ *   INPUTS: syscall_stat_t * stat - the statistics.
+ *           int32_t ret - what the call returned.
+ *           uint64_t cycles - how long it took.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void syscall_record(syscall_stat_t * stat, int32_t ret, uint64_t cycles)
+{
+    uint32_t scaled = (cycles >> 32) ? 0xFFFFFFFF : (uint32_t)cycles;
+    int bucket = 0;
+
+    if (ret == FAILURE) {
+        stat->errors++;
+    }
+    stat->cycles += cycles;
+    scaled >>= SYSCALL_HIST_SHIFT;
+    while (scaled != 0 && bucket < SYSCALL_HIST_BUCKETS - 1) {
+        scaled >>= 1;
+        bucket++;
+    }
+    stat->hist[bucket]++;
+}
+
+/*
+ * syscall_dispatch(uint32_t index, int32_t arg0, int32_t arg1, int32_t arg2)
+ *   DESCRIPTION: Runs a system call handler for both trap entry points,
+ *                timing it with the TSC and counting it against the calling
+ *                process and the totals.
+ *   INPUTS: uint32_t index - system call number less one, checked by the
+ *                            caller.
+ *           int32_t arg0, arg1, arg2 - the call's arguments.
+ *   OUTPUTS: none
+ *   RETURN VALUE: What the handler returned.
+ *   SIDE EFFECTS: Those of the handler, run under the kernel lock. halt
+ *                 does not return, so it is counted but never timed.
+ */
+int32_t syscall_dispatch(uint32_t index, int32_t arg0, int32_t arg1, int32_t arg2)
+{
+    pcb_t * pcb;
+    uint64_t start;
+    int32_t ret;
+    int flags = 0;
+    int locked;
+
+    // Calls from user mode take the kernel lock; calls the kernel makes on
+    // itself already hold it.
+    locked = lock_kernel();
+    pcb = &control_blocks[current_pid];
+    exec_first_event(current_pid);
+    pcb->syscalls[index].calls++;
+    irq_save(flags);
+    syscall_totals[index].calls++;
+    irq_restore(flags);
+
+    start = rdtsc64();
+    ret = syscalltable[index](arg0, arg1, arg2);
+    start = rdtsc64() - start;
+
+    syscall_record(&pcb->syscalls[index], ret, start);
+    irq_save(flags);
+    syscall_record(&syscall_totals[index], ret, start);
+    irq_restore(flags);
+    unlock_kernel(locked);
+    return ret;
+}
+
+/*
+ * sysstat(int32_t pid, syscall_stat_t * buf)
+ *   DESCRIPTION: Copies out the system call statistics of a process, or
+ *                the totals since boot.
+ *   INPUTS: int32_t pid - a running process, or SYSSTAT_ALL.
+ *           syscall_stat_t * buf - user buffer for NUM_SYSCALLS entries, in
+ *                                  system call number order.
+ *   OUTPUTS: The statistics, to buf.
+ *   RETURN VALUE: NUM_SYSCALLS, or -1 for a bad buffer or a pid that is
+ *                 not running.
+ *   SIDE EFFECTS: none
+ */
+int32_t sysstat(int32_t pid, syscall_stat_t * buf)
+{
+    syscall_stat_t * stats;
+    int flags = 0;
+
+    if ((uint32_t)buf < USER_PAGE_START ||
+        (uint32_t)buf > USER_PAGE_START + M_4 - sizeof(syscall_totals)) {
+        return FAILURE;
+    }
+    if (pid == SYSSTAT_ALL) {
+        stats = syscall_totals;
+    } else if (pid > SENTINEL_PROCESS && pid < TOTAL_PROCESSES &&
+               control_blocks[pid].pid != -1) {
+        stats = control_blocks[pid].syscalls;
+    } else {
+        return FAILURE;
+    }
+
+    irq_save(flags);
+    memcpy(buf, stats, sizeof(syscall_totals));
+    irq_restore(flags);
+    return NUM_SYSCALLS;
+}
@@ -0,0 +1,30 @@
+/* sysstat.h - Per-process system call counters and latency histograms.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#include "types.h"
+#include "sysnum.h"
+
+#define SYSCALL_HIST_BUCKETS    16  // Buckets in each latency histogram.
+#define SYSCALL_HIST_SHIFT      7   // Bucket 0 holds calls under 2^7 cycles.
+#define SYSSTAT_ALL             -1  // sysstat pid for the totals since boot.
+
+// System Call Statistics Structure, one per system call. Bucket k > 0 of
+// hist counts calls that took [2^(SYSCALL_HIST_SHIFT + k - 1),
+// 2^(SYSCALL_HIST_SHIFT + k)) cycles, the last bucket also everything
+// longer. A call that blocks is charged the time it was blocked, and
+// execute the whole run of the program it started.
+typedef struct syscall_stat
+{
+    uint32_t calls;
+    uint32_t errors;            // Calls that returned -1.
+    uint64_t cycles;            // Cycles from dispatch to return, summed.
+    uint32_t hist[SYSCALL_HIST_BUCKETS];
+} syscall_stat_t;
+
+// Every process's calls since boot, exited ones included.
+syscall_stat_t syscall_totals[NUM_SYSCALLS];
+
+extern int32_t syscall_dispatch(uint32_t index, int32_t arg0, int32_t arg1, int32_t arg2);
+extern int32_t sysstat(int32_t pid, syscall_stat_t * buf);
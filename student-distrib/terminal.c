@@ -4,6 +4,8 @@
 #include "terminal.h"
 volatile unsigned char return_switch[NUM_TERMINALS];
 unsigned char read_buffer[NUM_TERMINALS][MAX_BUFFER_SIZE];
+wait_queue_t terminal_wait_queue[NUM_TERMINALS]; // Processes waiting in terminal_read for return.
+uint32_t return_tsc[NUM_TERMINALS]; // Keyboard interrupt TSC of each terminal's last return.
 unsigned char cursor_location[MAX_PROCESSES];
 uint8_t vid_save_arr[NUM_TERMINALS][NUM_COLS * NUM_ROWS];
 
@@ -38,6 +40,7 @@ int32_t terminal_switch(uint8_t num)
 
 	previous_terminal = current_terminal;
 	current_terminal = num;
+	set_vidmap_terminal(current_terminal);
 
 	if (terminal_running[current_terminal] == 1)
 	{
@@ -50,6 +53,7 @@ int32_t terminal_switch(uint8_t num)
 		cursor_update();
 
 		terminal_request = current_terminal;
+		schedule_kick();
 		int schedule_ticked = schedule_tick;
 		send_eoi(IRQ1);
 		sti();
@@ -64,6 +68,11 @@ int32_t terminal_switch(uint8_t num)
 
 		terminal_clear();
 		send_eoi(IRQ1);
+		// The new shell's parent frames bury the interrupted process's
+		// stack, so it carries on from where it was last switched out.
+		if (!this_cpu()->idle_running && control_blocks[current_pid].sched_esp != 0) {
+			schedule_enqueue(current_pid);
+		}
 		current_pid = SENTINEL_PROCESS;
 		current_process = current_terminal;
 
@@ -97,6 +106,7 @@ int32_t terminal_open(const uint8_t* filename) {
 	for (i = 0; i < NUM_TERMINALS; i++)
 	{
 		return_switch[i] = 0;
+		wait_queue_init(&terminal_wait_queue[i]);
 
 		terminal_running[i] = 0;
 		switch_data_arr[i].cursor_x = 0;
@@ -104,12 +114,9 @@ int32_t terminal_open(const uint8_t* filename) {
 
 		schedule_top[i]= 0;
 
-		for (j = 0; j < 7; j++)
+		for (j = 0; j < TOTAL_PROCESSES; j++)
 		{
 			schedule_stack[i][j] = 0;
-
-			schedule_ebp[i][j] = 0;
-			schedule_esp[i][j] = 0;
 		}
 
 		for (m = 0; m < NUM_ROWS * NUM_COLS; m++)
@@ -148,11 +155,12 @@ int32_t terminal_close(int32_t fd) {
  */
 int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes)
 {
+	int flags = 0;
 	// Parameter check.
 	if (nbytes < 1) {
 		return FAILURE;
 	}
-	cli();
+	spin_lock_irqsave(&terminal_lock, flags);
 	char * output;
 	output = (char *) buf;
 
@@ -181,9 +189,7 @@ int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes)
 		// Update display appropriately
 		if (call_next_line == 1)
 		{
-			sti();
 			next_line();
-			cli();
 		}
 		i++;
 	}
@@ -191,23 +197,44 @@ int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes)
 	cursor_update();
 
 	send_eoi(IRQ1);
-	sti();
+	spin_unlock_irqrestore(&terminal_lock, flags);
 	return i;
 }
 
+/* void record_read_latency(uint32_t cycles)
+ * Description: Adds a keyboard-to-read latency to read_latency_hist.
+ * Inputs:      uint32_t cycles - the latency.
+ * Outputs:     NONE
+ * Return Value: NONE
+ * Side Effects:  NONE
+ */
+static void record_read_latency(uint32_t cycles)
+{
+	int bucket = 0;
+	cycles >>= LATENCY_SHIFT;
+	while (cycles != 0 && bucket < LATENCY_BUCKETS - 1) {
+		cycles >>= 1;
+		bucket++;
+	}
+	read_latency_hist[bucket]++;
+}
+
 /* int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes)
  * Description: Waits for an return key press, and then copies the keyboard buffer to a given buffer.
- * Inputs:      int32_t fd - File descriptor. Unusused.
+ * 				A line that came in after terminal_poll asked for one is taken at once.
+ * Inputs:      int32_t fd - File descriptor. Only its O_NONBLOCK flag is used.
  * 				void * buf - Buffer to copy keyboard buffer to.
  * 				int32_t nbytes - Number of bytes to copy.
  * Outputs:     NONE
  * Return Value: From keyboard_read - Number of characters/bytes copied.
+ * 				FAILURE with O_NONBLOCK if no line is ready yet.
  * Side Effects: Requires interrupts from the keyboard.
  */
 int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes)
 {
 	int byte_cnt;
 	int i;
+	int flags = 0;
 	byte_cnt = 0;
 	// Parameter check.
 	if (nbytes < 1) {
@@ -217,16 +244,28 @@ int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes)
 		return FAILURE;
 	}
 	int cip = current_process;
-	// Set return switch to on.
-	return_switch[cip] = SWITCH_ON;
+	int nonblock = (fd >= 0 && fd < FDT_SIZE) && (control_blocks[current_pid].fd_table[fd].flags & O_NONBLOCK);
 
-	// Wait for return signal.
-	sti();
-	while (return_switch[cip] != SWITCH_OFF) {}
-	cli();
+	// Set return switch to on, unless a line is already waiting.
+	irq_save(flags);
+	if (return_switch[cip] != SWITCH_READY) {
+		return_switch[cip] = SWITCH_ON;
+	}
+	if (nonblock && return_switch[cip] != SWITCH_READY) {
+		irq_restore(flags);
+		return FAILURE;
+	}
+
+	// Sleep until the return signal.
+	while (return_switch[cip] != SWITCH_READY) {
+		wait_queue_sleep(&terminal_wait_queue[cip]);
+	}
+	return_switch[cip] = SWITCH_OFF;
+	spin_lock(&terminal_lock);
 
 	// Set null termination on last character, then copy to destination.
 	read_buffer[cip][nbytes - 1] = '\0';
+	record_read_latency(rdtsc() - return_tsc[cip]);
 
 	i = 0;
 	while (read_buffer[cip][i] != '\n') {
@@ -239,11 +278,35 @@ int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes)
 	cursor_update(); // Update cursor
 
 	send_eoi(IRQ1);
-	sti();
+	spin_unlock_irqrestore(&terminal_lock, flags);
 
 	return i + 1;
 }
 
+/* int32_t terminal_poll(int32_t fd)
+ * Description: Readiness hook for poll on stdin. Asks the keyboard for the next line,
+ * 				as terminal_read would, without waiting for it.
+ * Inputs:      int32_t fd - File descriptor. Unused.
+ * Outputs:     NONE
+ * Return Value: POLLIN if a line is waiting, else 0.
+ * Side Effects: Turns the return switch on, so the next return key hands its
+ * 				line over and wakes poll_wait_queue.
+ */
+int32_t terminal_poll(int32_t fd)
+{
+	int cip = current_process;
+	int ready;
+	int flags = 0;
+
+	irq_save(flags);
+	if (return_switch[cip] != SWITCH_READY) {
+		return_switch[cip] = SWITCH_ON;
+	}
+	ready = (return_switch[cip] == SWITCH_READY);
+	irq_restore(flags);
+	return ready ? POLLIN : 0;
+}
+
 /* int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes)
  * Description: Waits for an return key press, and then copies the keyboard buffer to a given buffer.
  * Inputs:      int32_t fd - File descriptor. Unusused.
@@ -292,8 +355,12 @@ void terminal_backspace() {
 void terminal_return() {
 	if (return_switch[current_terminal] == SWITCH_ON) {
 		keyboard_read(1, read_buffer[current_terminal], MAX_BUFFER_SIZE);
-		set_return_switch(0);
-	} else if (return_switch[current_terminal] == SWITCH_OFF) {
+		set_return_switch_spec(current_terminal, SWITCH_READY);
+		return_tsc[current_terminal] = keyboard_irq_tsc;
+		wait_queue_wake(&terminal_wait_queue[current_terminal]);
+		wait_queue_wake(&poll_wait_queue);
+	} else if (return_switch[current_terminal] == SWITCH_OFF ||
+			return_switch[current_terminal] == SWITCH_READY) {
 		// Scroll if near bottom of page. Else, next line.
 		next_line();
 		cursor_update(); // Update cursor
@@ -350,7 +417,7 @@ void set_return_switch(unsigned char value) {
  */
 void set_return_switch_spec(unsigned char terminal, unsigned char value) {
 	if (terminal < NUM_TERMINALS) {
-		if (value == SWITCH_OFF || value == SWITCH_ON || value == SWITCH_HOLD) {
+		if (value == SWITCH_OFF || value == SWITCH_ON || value == SWITCH_HOLD || value == SWITCH_READY) {
 			return_switch[terminal] = value;
 		}
 	}
@@ -13,6 +13,7 @@
 #include "filesystem_driver.h"
 #include "interrupts.h"
 #include "i8259.h"
+#include "lock.h"
 
 #define NUM_COLS 		80
 #define NUM_ROWS		25
@@ -21,9 +22,13 @@
 #define SWITCH_OFF  0
 #define SWITCH_ON   1
 #define SWITCH_HOLD 2
+#define SWITCH_READY 3 // A line is in read_buffer, waiting for terminal_read.
 
 #define NUM_TERMINALS   3
 
+#define LATENCY_BUCKETS 16  // Buckets in the read latency histogram.
+#define LATENCY_SHIFT   12  // Bucket 0 holds latencies under 2^12 cycles.
+
 // Process Control Block Structure.
 typedef struct s_d {
     uint8_t vid_data[2 * NUM_COLS * NUM_ROWS];
@@ -34,8 +39,16 @@ typedef struct s_d {
 switch_data switch_data_arr[NUM_TERMINALS];
 
 int terminal_running[NUM_TERMINALS];
+
+// Cycles from the keyboard interrupt of a return key to terminal_read
+// returning the line. Bucket k > 0 counts latencies in
+// [2^(LATENCY_SHIFT + k - 1), 2^(LATENCY_SHIFT + k)), the last bucket
+// also everything longer.
+uint32_t read_latency_hist[LATENCY_BUCKETS];
+
+// Guards the screen cursor and line buffers against concurrent writers.
+spinlock_t terminal_lock;
 int current_terminal;
-int last_esp;
 
 int switch_ebp;
 
@@ -44,6 +57,7 @@ int switch_esp;
 extern int32_t terminal_open(const uint8_t* filename);
 extern int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes);
 extern int32_t terminal_read(int32_t fd, void *buf, int32_t nbytes);
+extern int32_t terminal_poll(int32_t fd);
 extern int32_t terminal_close(int32_t fd);
 
 extern int32_t terminal_read_fail(int32_t fd, void *buf, int32_t nbytes);
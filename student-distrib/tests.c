@@ -6,6 +6,13 @@
 #include "filesystem_driver.h"
 #include "terminal.h"
 #include "syscalls.h"
+#include "frame_allocator.h"
+#include "clocksource.h"
+#include "smp.h"
+#include "lock.h"
+#include "apic.h"
+#include "vdso.h"
+
 #define PASS 1
 #define FAIL 0
 
@@ -965,7 +972,7 @@ int syscall_parameter_test()
         return FAIL;
     }
 
-    retval = do_call(11, 0, 0, 0);
+    retval = do_call(NUM_SYSCALLS + 1, 0, 0, 0);
     // printf("Test 1: %d \n", retval);
     if (retval >= 0) {
         return FAIL;
@@ -977,50 +984,1591 @@ int syscall_parameter_test()
 /* Checkpoint 4 tests */
 /* Checkpoint 5 tests */
 
+/* Benchmarks */
 
-/* Test suite entry point */
-void launch_tests()
+#define BENCH_FILE      "verylargetextwithverylongname.tx"
+#define BENCH_PASSES    64
+#define BENCH_CHUNK     1024
+#define BENCH_BUF_SIZE  8192
+
+static uint8_t bench_buf[BENCH_BUF_SIZE];
+
+/* read_data_bytewise
+ *   Reference copy loop with the shape of the old read_data engine: one
+ *   byte per iteration, a modulo on every byte to spot block boundaries and
+ *   a data_blocks[] walk at each boundary. Only used as the benchmark baseline.
+ */
+static int32_t read_data_bytewise(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length)
 {
-    // Set screen position to top left corner.
-    terminal_clear();
+    uint32_t num = node_list[inode].B_length;
+    uint8_t* data_pointer;
+    uint32_t i = 0;
+    uint32_t j = offset % FILE_SIZE;
+    uint32_t loop = offset / FILE_SIZE;
+
+    data_pointer = (uint8_t*) &data_list[node_list[inode].data_blocks[loop]];
+    while (i != length && offset + i < num)
+    {
+        buf[i] = data_pointer[j];
+        i++;
+        j++;
+        if ((j % FILE_SIZE) == 0) {
+            j = 0;
+            loop++;
+            data_pointer = (uint8_t*) &data_list[node_list[inode].data_blocks[loop]];
+        }
+    }
+    return i;
+}
 
-    // launch your tests here
-    // TEST_OUTPUT("idt_test", idt_test());
-    // TEST_OUTPUT("divide by zero test", div_zero_test());
-    // TEST_OUTPUT("deref null test", dref_null_test());
+/* Benchmark - read_data throughput
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Prints bytes per cycle (x100) for the bytewise baseline and
+ *               for the block-granular engine, both as cat-sized 1 KB reads
+ *               through file_read and as one whole-file read_data call.
+ *               Every pass reads the same first BENCH_BUF_SIZE bytes at most,
+ *               so the three numbers compare.
+ * Coverage: read_data, file_read block cursor
+ * Files: filesystem_driver.c
+ */
+int bench_read_data_throughput()
+{
+    TEST_HEADER;
 
-    // TEST_OUTPUT("Test Syscall: Open" , syscall_open_test());
-    // TEST_OUTPUT("Test Syscall: Close", syscall_close_test());
-    // TEST_OUTPUT("Test Syscall: Read File" , syscall_read_file_test());
-    // TEST_OUTPUT("Test Syscall: Read Directory" , syscall_read_directory_test());
-    // TEST_OUTPUT("Test Syscall: Read and Write RTC" , syscall_read_write_rtc_test());
-    // TEST_OUTPUT("Test Syscall: Write", syscall_write_fd_test());
+    dir_entry_t dentry;
+    uint32_t start, old_cycles, chunk_cycles, whole_cycles;
+    uint32_t total, size, offset, chunk;
+    int32_t ret;
+    int fd, pass;
 
-    // TEST_OUTPUT("Test File: Open", file_open_test());
-    // TEST_OUTPUT("Test File: Read Binary", file_read_binary_test());
-    // TEST_OUTPUT("Test File: Read Text", file_read_text_test());
-    // TEST_OUTPUT("Test File: Read Long", file_read_long_test());
-    // TEST_OUTPUT("Test File: Close", file_close_test());
-    // TEST_OUTPUT("Test File: Write", file_write_test());
+    if (read_dentry_by_name((const uint8_t *)BENCH_FILE, &dentry) == -1) {
+        return FAIL;
+    }
+    size = node_list[dentry.inode_num].B_length;
+    if (size > BENCH_BUF_SIZE) {
+        size = BENCH_BUF_SIZE;
+    }
 
-    // TEST_OUTPUT("Test Dir: Read", dir_read_test());
-    // TEST_OUTPUT("Test Dir: write", dir_write_test());
-    // TEST_OUTPUT("Test Dir: open", dir_open_test());
-    // TEST_OUTPUT("Test Dir: Close", dir_close_test());
+    /** Baseline: bytewise copy in 1 KB chunks, like cat */
+    total = 0;
+    start = rdtsc();
+    for (pass = 0; pass < BENCH_PASSES; pass++) {
+        for (offset = 0; offset < size; offset += ret) {
+            chunk = (size - offset < BENCH_CHUNK) ? size - offset : BENCH_CHUNK;
+            ret = read_data_bytewise(dentry.inode_num, offset, bench_buf, chunk);
+            if (ret <= 0) {
+                return FAIL;
+            }
+            total += ret;
+        }
+    }
+    old_cycles = rdtsc() - start;
+
+    /** Block engine through file_read, so the fd cursor is exercised */
+    total = 0;
+    start = rdtsc();
+    for (pass = 0; pass < BENCH_PASSES; pass++) {
+        fd = file_open((const uint8_t *)BENCH_FILE);
+        if (fd == -1) {
+            return FAIL;
+        }
+        for (offset = 0; offset < size; offset += ret) {
+            chunk = (size - offset < BENCH_CHUNK) ? size - offset : BENCH_CHUNK;
+            ret = file_read(fd, bench_buf, chunk);
+            if (ret <= 0) {
+                file_close(fd);
+                return FAIL;
+            }
+            total += ret;
+        }
+        file_close(fd);
+    }
+    chunk_cycles = rdtsc() - start;
+    if (total != size * BENCH_PASSES) {
+        printf("file_read returned %u bytes, expected %u\n", total, size * BENCH_PASSES);
+        return FAIL;
+    }
 
-    // TEST_OUTPUT("keyboard_open", test_keyboard_open());
-    // TEST_OUTPUT("keyboard_write", test_keyboard_write());
+    /** Block engine, whole file in one call */
+    start = rdtsc();
+    for (pass = 0; pass < BENCH_PASSES; pass++) {
+        if (read_data(dentry.inode_num, 0, bench_buf, size) != size) {
+            return FAIL;
+        }
+    }
+    whole_cycles = rdtsc() - start;
 
-    // TEST_OUTPUT("terminal_open", test_terminal_open());
-    // TEST_OUTPUT("terminal_write", test_terminal_write());
-    // TEST_OUTPUT("terminal_read", test_terminal_read());
+    total = size * BENCH_PASSES;
+    printf("bytewise 1KB reads: %u bytes/100 cycles\n", (total * 100) / (old_cycles + 1));
+    printf("block    1KB reads: %u bytes/100 cycles\n", (total * 100) / (chunk_cycles + 1));
+    printf("block   whole file: %u bytes/100 cycles\n", (total * 100) / (whole_cycles + 1));
 
-    // TEST_OUTPUT("Test RTC: Open", rtc_open_test());
-    // TEST_OUTPUT("Test RTC: Write", rtc_write_test());
+    return PASS;
+}
 
-    // TEST_OUTPUT("Test File: syscall_open", syscall_terminal_write_test());
 
-    // TEST_OUTPUT("Test File: system_call", syscall_parameter_test());
+#define LOOKUP_ROUNDS   256
+
+/* Benchmark - dentry lookup
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Prints the average cycles per read_dentry_by_name call for
+ *               names in the directory and for shell-style typos.
+ * Coverage: read_dentry_by_name, filename hash index
+ * Files: filesystem_driver.c
+ */
+int bench_dentry_lookup()
+{
+    TEST_HEADER;
+
+    static const int8_t * hits[] = {
+        ".", "rtc", "shell", "ls", "cat", "grep", "hello", "counter",
+        "pingpong", "fish", "frame0.txt", "frame1.txt", BENCH_FILE
+    };
+    static const int8_t * misses[] = {
+        "shel", "sl", "cta", "gerp", "helo", "fihs", "frame2.txt", "lss",
+        "pingpongs", "counte", "Shell", "verylargetextwithverylongname.t"
+    };
+    int num_hits = sizeof(hits) / sizeof(hits[0]);
+    int num_misses = sizeof(misses) / sizeof(misses[0]);
+    dir_entry_t dentry;
+    uint32_t start, hit_cycles, miss_cycles;
+    int round, i;
+
+    start = rdtsc();
+    for (round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (i = 0; i < num_hits; i++) {
+            if (read_dentry_by_name((const uint8_t *)hits[i], &dentry) != 0) {
+                printf("missed %s\n", hits[i]);
+                return FAIL;
+            }
+        }
+    }
+    hit_cycles = rdtsc() - start;
+
+    start = rdtsc();
+    for (round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (i = 0; i < num_misses; i++) {
+            if (read_dentry_by_name((const uint8_t *)misses[i], &dentry) != -1) {
+                printf("found %s\n", misses[i]);
+                return FAIL;
+            }
+        }
+    }
+    miss_cycles = rdtsc() - start;
+
+    printf("hit:  %u cycles/lookup\n", hit_cycles / (LOOKUP_ROUNDS * num_hits));
+    printf("miss: %u cycles/lookup\n", miss_cycles / (LOOKUP_ROUNDS * num_misses));
+
+    return PASS;
+}
+
+#define EXEC_ROUNDS     8
+
+/* Benchmark - exec latency
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Runs small programs from the sentinel process and prints the
+ *               average cycles from execute entry to the iret into user code,
+ *               and to the program's first page fault or system call, which
+ *               counts the demand paging it starts with. Also prints how
+ *               many program pages each run faulted in.
+ * Coverage: execute, demand-paged program loader
+ * Files: syscalls.c, process_control.c, exception-handlers.c
+ */
+int bench_exec_latency()
+{
+    TEST_HEADER;
+
+    static const int8_t * programs[] = { "testprint", "ls", "cat", "grep" };
+    int num_programs = sizeof(programs) / sizeof(programs[0]);
+    uint32_t total, first, faults;
+    int round, i;
+
+    for (i = 0; i < num_programs; i++) {
+        total = 0;
+        first = 0;
+        faults = 0;
+        for (round = 0; round < EXEC_ROUNDS; round++) {
+            if (do_call(SYS_EXECUTE, (int)programs[i], 0, 0) == -1) {
+                return FAIL;
+            }
+            total += exec_latency_cycles;
+            first += exec_first_cycles;
+            faults += last_page_faults;
+        }
+        printf("%s: %u cycles execute to iret, %u to first fault or syscall, %u page faults\n",
+            programs[i], total / EXEC_ROUNDS, first / EXEC_ROUNDS, faults / EXEC_ROUNDS);
+    }
+
+    /** Not runnable: too large or not an executable */
+    if (do_call(SYS_EXECUTE, (int)"frame0.txt", 0, 0) != -1) {
+        return FAIL;
+    }
+
+    return PASS;
+}
+
+/* Frame Allocator Stress Test
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Starts processes that each touch their whole program region
+ *               until the frame allocator runs dry or the process control
+ *               blocks run out, tears them down, then runs a real program.
+ *               Every frame has to come back each time.
+ * Coverage: frame_alloc, frame_free, execute, halt
+ * Files: frame_allocator.c, process_control.c, syscalls.c
+ */
+int frame_allocator_stress_test()
+{
+    TEST_HEADER;
+
+    int pids[MAX_PROCESSES];
+    int num_pids = 0;
+    int out_of_memory = 0;
+    uint32_t start_free = free_frames;
+    uint32_t page;
+    int pid, i;
+
+    while (!out_of_memory && (pid = create_new_pcb(current_pid)) != FAILURE) {
+        pids[num_pids++] = pid;
+        init_program_pages(pid, 0, 0);
+        init_page_directory(pid);
+        load_page_directory(pid);
+        for (page = USER_PAGE_START; page < USER_PAGE_START + M_4; page += PAGE_4KB) {
+            if (fault_program_page(pid, page) == FAILURE) {
+                out_of_memory = 1;
+                break;
+            }
+        }
+    }
+    printf("%d processes, %u of %u frames used, %s\n", num_pids,
+        start_free - free_frames, total_frames,
+        out_of_memory ? "out of memory" : "out of processes");
+
+    for (i = 0; i < num_pids; i++) {
+        free_program_pages(pids[i]);
+        destroy_pcb(pids[i]);
+    }
+    load_page_directory(current_pid);
+    if (free_frames != start_free) {
+        return FAIL;
+    }
+
+    /** execute and halt must give back every frame the program touched */
+    if (do_call(SYS_EXECUTE, (int)"testprint", 0, 0) == -1) {
+        return FAIL;
+    }
+    if (free_frames != start_free) {
+        return FAIL;
+    }
+
+    return PASS;
+}
+
+/* Benchmark - context switch
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Runs counter (type 2 at the prompt for the long run) and
+ *               prints the average cycles timer_handler spent switching to
+ *               the next process.
+ * Coverage: timer_handler, per-process page directories
+ * Files: interrupts.c, process_control.c
+ */
+int bench_context_switch()
+{
+    TEST_HEADER;
+
+    switch_cycles = 0;
+    switch_count = 0;
+    if (do_call(SYS_EXECUTE, (int)"counter", 0, 0) == -1) {
+        return FAIL;
+    }
+    if (switch_count == 0) {
+        return FAIL;
+    }
+
+    printf("%u switches, %u cycles per switch\n", switch_count, switch_cycles / switch_count);
+    return PASS;
+}
+
+#define TICK_ROUNDS     100
+
+/* Benchmark - tick cost
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Prints the average cycles spent in a timer interrupt, first
+ *               over TICK_ROUNDS of them, then while counter runs (type 2 at
+ *               the prompt for the long run).
+ * Coverage: timer_handler, global pages
+ * Files: interrupts.c, paging.S
+ */
+int bench_tick_cost()
+{
+    TEST_HEADER;
+
+    sti();
+    tick_cycles = 0;
+    timer_irqs = 0;
+    while (timer_irqs < TICK_ROUNDS) {}
+    printf("idle: %u cycles per tick\n", tick_cycles / timer_irqs);
+
+    tick_cycles = 0;
+    timer_irqs = 0;
+    if (do_call(SYS_EXECUTE, (int)"counter", 0, 0) == -1) {
+        return FAIL;
+    }
+    if (timer_irqs == 0) {
+        return FAIL;
+    }
+    printf("counter: %u cycles per tick over %u ticks\n", tick_cycles / timer_irqs, timer_irqs);
+
+    return PASS;
+}
+
+#define COUNTER_LINES       100000  // Lines counter prints for choice 2.
+
+/* Benchmark - CPU-bound counter next to an idle shell
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Runs counter. Type 2 at the prompt, press Alt+F2 to start a
+ *               shell that sits in terminal_read, then Alt+F1 to come back.
+ *               Prints how many of the ticks counter was runnable for it
+ *               actually ran, and its rate in lines per second. A blocked
+ *               shell should leave counter close to every tick.
+ * Coverage: wait queues, timer_handler, terminal_read
+ * Files: wait_queue.c, interrupts.c, terminal.c
+ */
+int bench_counter_next_to_idle_shell()
+{
+    TEST_HEADER;
+
+    if (do_call(SYS_EXECUTE, (int)"counter", 0, 0) == -1) {
+        return FAIL;
+    }
+    if (last_ready_ticks == 0) {
+        return FAIL;
+    }
+
+    printf("counter: ran %u of %u runnable ticks, %u lines per second\n",
+        last_run_ticks, last_ready_ticks,
+        COUNTER_LINES * 1000 / (last_ready_ticks * (tick_period_ns / 1000) / 1000));
+
+    return PASS;
+}
+
+/* Benchmark - idle time
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Runs counter, which sits at its prompt until a choice is
+ *               typed, and prints how many of the ticks in between landed
+ *               in the idle context and the cycles it spent halted.
+ * Coverage: idle context, timer_handler
+ * Files: interrupts.c, wait_queue.c
+ */
+int bench_idle_time()
+{
+    TEST_HEADER;
+
+    uint32_t start_ticks = tick_count;
+    uint32_t start_idle = cpus[0].idle_ticks;
+    uint32_t start_cycles = cpus[0].idle_cycles;
+    uint32_t elapsed;
+
+    if (do_call(SYS_EXECUTE, (int)"counter", 0, 0) == -1) {
+        return FAIL;
+    }
+    elapsed = tick_count - start_ticks;
+    if (elapsed == 0) {
+        return FAIL;
+    }
+
+    printf("idle: %u of %u ticks (%u%%), %u cycles halted\n",
+        cpus[0].idle_ticks - start_idle, elapsed,
+        (cpus[0].idle_ticks - start_idle) * 100 / elapsed, cpus[0].idle_cycles - start_cycles);
+
+    return PASS;
+}
+
+#define FAIRNESS_WORKERS    6   // CPU-bound processes sharing the CPU.
+#define FAIRNESS_TICKS      600 // Ticks to let them run for.
+
+static volatile uint32_t fairness_loops[FAIRNESS_WORKERS];
+static volatile int fairness_stop;
+static int fairness_slot[TOTAL_PROCESSES];
+
+/* Benchmark helper - CPU-bound background process
+ * Counts loop iterations into its slot until told to stop.
+ */
+static void fairness_worker()
+{
+    int slot = fairness_slot[current_pid];
+    while (!fairness_stop) {
+        fairness_loops[slot]++;
+    }
+    exit_kernel_process();
+}
+
+/* Benchmark - run queue fairness
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Starts six background kernel processes that spin on the CPU
+ *               next to the test itself, then prints the ticks and loop
+ *               iterations each one got, the smallest share as a percentage
+ *               of the largest and Jain's fairness index (100 is perfectly fair).
+ * Coverage: run queue, timer_handler, create_kernel_process
+ * Files: run_queue.c, interrupts.c, process_control.c
+ */
+int bench_run_queue_fairness()
+{
+    TEST_HEADER;
+
+    int pids[FAIRNESS_WORKERS];
+    uint32_t ticks[FAIRNESS_WORKERS];
+    uint32_t start_ticks;
+    uint32_t min_ticks = 0xFFFFFFFF;
+    uint32_t max_ticks = 0;
+    uint32_t sum = 0;
+    uint32_t sum_squares = 0;
+    int done;
+    int i;
+
+    cli();
+    fairness_stop = 0;
+    for (i = 0; i < FAIRNESS_WORKERS; i++) {
+        fairness_loops[i] = 0;
+        pids[i] = create_kernel_process(fairness_worker);
+        if (pids[i] == -1) {
+            fairness_stop = 1;
+            sti();
+            return FAIL;
+        }
+        fairness_slot[pids[i]] = i;
+    }
+    start_ticks = tick_count;
+    sti();
+
+    while (tick_count - start_ticks < FAIRNESS_TICKS) {}
+    fairness_stop = 1;
+
+    // Wait for every worker to exit.
+    do {
+        done = 1;
+        for (i = 0; i < FAIRNESS_WORKERS; i++) {
+            if (control_blocks[pids[i]].pid != -1) {
+                done = 0;
+            }
+        }
+    } while (!done);
+
+    for (i = 0; i < FAIRNESS_WORKERS; i++) {
+        ticks[i] = control_blocks[pids[i]].run_ticks;
+        printf("worker %d: %u ticks, %u loops\n", i, ticks[i], fairness_loops[i]);
+        if (ticks[i] < min_ticks) {
+            min_ticks = ticks[i];
+        }
+        if (ticks[i] > max_ticks) {
+            max_ticks = ticks[i];
+        }
+        sum += ticks[i];
+        sum_squares += ticks[i] * ticks[i];
+    }
+    if (min_ticks == 0) {
+        return FAIL;
+    }
+
+    printf("min/max share: %u%%, Jain's index: %u\n",
+        min_ticks * 100 / max_ticks, sum * sum * 100 / (FAIRNESS_WORKERS * sum_squares));
+
+    return PASS;
+}
+
+#define LATENCY_LINES   10  // Lines to type during the latency benchmark.
+
+/* Benchmark - keystroke latency under load
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Starts six CPU-bound background processes, then reads ten
+ *               lines from the keyboard and prints the histogram of cycles
+ *               from each return key's interrupt to terminal_read returning.
+ * Coverage: MLFQ boost, terminal_read, wait queues
+ * Files: interrupts.c, terminal.c, wait_queue.c
+ */
+int bench_keystroke_latency()
+{
+    TEST_HEADER;
+
+    int pids[FAIRNESS_WORKERS];
+    uint8_t buf[NUM_BYTES];
+    int done;
+    int i;
+
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        read_latency_hist[i] = 0;
+    }
+
+    cli();
+    fairness_stop = 0;
+    for (i = 0; i < FAIRNESS_WORKERS; i++) {
+        pids[i] = create_kernel_process(fairness_worker);
+        if (pids[i] == -1) {
+            fairness_stop = 1;
+            sti();
+            return FAIL;
+        }
+        fairness_slot[pids[i]] = i;
+    }
+    sti();
+
+    printf("Type %d lines\n", LATENCY_LINES);
+    for (i = 0; i < LATENCY_LINES; i++) {
+        terminal_read(0, buf, NUM_BYTES);
+    }
+    fairness_stop = 1;
+
+    // Wait for every worker to exit.
+    do {
+        done = 1;
+        for (i = 0; i < FAIRNESS_WORKERS; i++) {
+            if (control_blocks[pids[i]].pid != -1) {
+                done = 0;
+            }
+        }
+    } while (!done);
+
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        if (read_latency_hist[i] != 0) {
+            printf("< 2^%d cycles: %u\n", LATENCY_SHIFT + i, read_latency_hist[i]);
+        }
+    }
+
+    return PASS;
+}
+
+#define CLOCK_TEST_TICKS    40  // Timer ticks to time the clock against.
+
+/* Clocksource Test
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Times CLOCK_TEST_TICKS timer ticks with clock_ns and prints
+ *               how far that is from the PIT's own tick length, in parts
+ *               per thousand. Passes within 2%.
+ * Coverage: TSC calibration, clock_ns
+ * Files: clocksource.c
+ */
+int clocksource_test()
+{
+    TEST_HEADER;
+
+    uint32_t start_ticks;
+    uint64_t start_ns;
+    uint32_t elapsed;
+    uint32_t expected;
+    uint32_t error;
+
+    // Start on a tick edge.
+    start_ticks = tick_count;
+    while (tick_count == start_ticks) {}
+    start_ticks = tick_count;
+    start_ns = clock_ns();
+
+    while (tick_count - start_ticks < CLOCK_TEST_TICKS) {}
+    elapsed = (uint32_t)(clock_ns() - start_ns);
+    // Ticks are counted a slice at a time, so it may have gone past.
+    expected = (tick_count - start_ticks) * tick_period_ns;
+
+    error = (elapsed > expected) ? elapsed - expected : expected - elapsed;
+    error /= expected / 1000;
+    printf("TSC %u kHz: %u ns for %u ns of ticks, %u per mille off\n",
+        tsc_khz, elapsed, expected, error);
+
+    return (error < 20) ? PASS : FAIL;
+}
+
+#define IRQ_RATE_MS     2000    // Milliseconds to count loaded interrupts over.
+
+/* Benchmark - timer interrupt rate
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Blocks in terminal_read until enter is pressed, with
+ *               nothing else to run, then runs six CPU-bound background
+ *               processes for IRQ_RATE_MS. Prints the timer interrupts per
+ *               second in each state. Idle should be close to zero.
+ * Coverage: one-shot PIT, timer_handler, idle context
+ * Files: interrupts.c, clocksource.c
+ */
+int bench_timer_irq_rate()
+{
+    TEST_HEADER;
+
+    int pids[FAIRNESS_WORKERS];
+    uint8_t buf[NUM_BYTES];
+    uint32_t start_irqs;
+    uint32_t start_ms;
+    uint32_t elapsed;
+    int done;
+    int i;
+
+    printf("Wait a few seconds, then press enter\n");
+    start_irqs = timer_irqs;
+    start_ms = clock_ms();
+    terminal_read(0, buf, NUM_BYTES);
+    elapsed = clock_ms() - start_ms;
+    if (elapsed == 0) {
+        return FAIL;
+    }
+    printf("idle: %u timer interrupts in %u ms, %u per second\n",
+        timer_irqs - start_irqs, elapsed, (timer_irqs - start_irqs) * 1000 / elapsed);
+
+    cli();
+    fairness_stop = 0;
+    for (i = 0; i < FAIRNESS_WORKERS; i++) {
+        pids[i] = create_kernel_process(fairness_worker);
+        if (pids[i] == -1) {
+            fairness_stop = 1;
+            sti();
+            return FAIL;
+        }
+        fairness_slot[pids[i]] = i;
+    }
+    start_irqs = timer_irqs;
+    start_ms = clock_ms();
+    sti();
+
+    while (clock_ms() - start_ms < IRQ_RATE_MS) {}
+    elapsed = clock_ms() - start_ms;
+    printf("loaded: %u timer interrupts in %u ms, %u per second\n",
+        timer_irqs - start_irqs, elapsed, (timer_irqs - start_irqs) * 1000 / elapsed);
+    fairness_stop = 1;
+
+    // Wait for every worker to exit.
+    do {
+        done = 1;
+        for (i = 0; i < FAIRNESS_WORKERS; i++) {
+            if (control_blocks[pids[i]].pid != -1) {
+                done = 0;
+            }
+        }
+    } while (!done);
+
+    return PASS;
+}
+
+#define WHEEL_TEST_TIMERS   2000    // Timers armed at once.
+#define WHEEL_TEST_SPAN     300     // Furthest ahead a timer is set, in ticks.
+
+static wheel_timer_t wheel_test_timers[WHEEL_TEST_TIMERS];
+static uint32_t wheel_test_fired[WHEEL_TEST_TIMERS];
+static uint32_t wheel_test_count;
+
+/* wheel_test_fire
+ * Records the tick a test timer fired on.
+ * Inputs: int data - index of the timer
+ * Outputs: None
+ * Side Effects: Counts the timer as fired.
+ */
+static void wheel_test_fire(int data)
+{
+    wheel_test_fired[data] = tick_count;
+    wheel_test_count++;
+}
+
+/* Timer wheel test
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Arms WHEEL_TEST_TIMERS timers spread over WHEEL_TEST_SPAN
+ *               ticks, a few of them cancelled again, and waits for the rest
+ *               to fire. Prints the average cycles per timer_add. Every
+ *               timer must fire once, on or after its tick.
+ * Coverage: timer_add, timer_cancel, timer_wheel_run, cascading
+ * Files: timer_wheel.c, interrupts.c
+ */
+int timer_wheel_test()
+{
+    TEST_HEADER;
+
+    uint32_t start;
+    uint32_t cycles;
+    uint32_t late;
+    uint32_t expected;
+    int i;
+
+    cli();
+    wheel_test_count = 0;
+    start = tick_count;
+    cycles = rdtsc();
+    for (i = 0; i < WHEEL_TEST_TIMERS; i++) {
+        wheel_test_fired[i] = 0;
+        timer_init(&wheel_test_timers[i], wheel_test_fire, i);
+        timer_add(&wheel_test_timers[i], start + 1 + (i * 7919) % WHEEL_TEST_SPAN);
+    }
+    cycles = rdtsc() - cycles;
+    // Every tenth timer is cancelled and must never fire.
+    for (i = 0; i < WHEEL_TEST_TIMERS; i += 10) {
+        timer_cancel(&wheel_test_timers[i]);
+    }
+    expected = WHEEL_TEST_TIMERS - WHEEL_TEST_TIMERS / 10;
+    sti();
+
+    while (tick_count - start <= WHEEL_TEST_SPAN + 1) {}
+
+    late = 0;
+    for (i = 0; i < WHEEL_TEST_TIMERS; i++) {
+        if (i % 10 == 0) {
+            if (wheel_test_fired[i] != 0) {
+                return FAIL;
+            }
+            continue;
+        }
+        if ((int32_t)(wheel_test_fired[i] - wheel_test_timers[i].expires) < 0) {
+            return FAIL;
+        }
+        late += wheel_test_fired[i] - wheel_test_timers[i].expires;
+    }
+    printf("%u of %u timers fired, %u cycles per add, %u ticks late in total\n",
+        wheel_test_count, expected, cycles / WHEEL_TEST_TIMERS, late);
+
+    return (wheel_test_count == expected) ? PASS : FAIL;
+}
+
+#define SLEEP_TEST_SECONDS  1
+
+/* Sleep test
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Sleeps for SLEEP_TEST_SECONDS through the sleep system call
+ *               and prints how long it took and how many ticks the idle
+ *               context got meanwhile. The sleeper must not wake early and,
+ *               with nothing else to run, the CPU must have been idle.
+ * Coverage: sleep, sleep timer, wait queues
+ * Files: syscalls.c, timer_wheel.c, clocksource.c
+ */
+int sleep_test()
+{
+    TEST_HEADER;
+
+    uint32_t start_ms;
+    uint32_t start_idle;
+    uint32_t elapsed;
+    uint32_t idle;
+
+    start_idle = cpus[0].idle_ticks;
+    start_ms = clock_ms();
+    if (do_call(SYS_SLEEP, SLEEP_TEST_SECONDS, 0, 0) != 0) {
+        return FAIL;
+    }
+    elapsed = clock_ms() - start_ms;
+    idle = cpus[0].idle_ticks - start_idle;
+    printf("slept %u ms, %u ticks idle\n", elapsed, idle);
+
+    if (elapsed < SLEEP_TEST_SECONDS * 1000) {
+        return FAIL;
+    }
+    // Allow two ticks past the deadline, and a tick of running either side.
+    if (elapsed > SLEEP_TEST_SECONDS * 1000 + 2 * timeslice_ms) {
+        return FAIL;
+    }
+    return (idle * timeslice_ms + 2 * timeslice_ms >= SLEEP_TEST_SECONDS * 1000) ? PASS : FAIL;
+}
+
+#define RTC_TEST_READERS    3
+#define RTC_TEST_SECONDS    2       // Time each reader runs for.
+
+static const int32_t rtc_test_rates[RTC_TEST_READERS] = { 2, 32, 1024 };
+static int rtc_test_slot[TOTAL_PROCESSES];
+static uint32_t rtc_test_ns[RTC_TEST_READERS];
+static uint32_t rtc_test_irqs[RTC_TEST_READERS];
+static int32_t rtc_test_status[RTC_TEST_READERS];
+
+/* rtc_test_reader
+ * Background process for rtc_virtual_test. Opens the RTC at its rate and
+ * times RTC_TEST_SECONDS worth of reads.
+ * Inputs: None
+ * Outputs: None
+ * Side Effects: Fills in its slot of the rtc_test arrays, then exits.
+ */
+static void rtc_test_reader()
+{
+    int slot = rtc_test_slot[current_pid];
+    int32_t rate = rtc_test_rates[slot];
+    uint64_t start_ns;
+    uint32_t start_irqs;
+    int32_t fd;
+    int i;
+
+    rtc_test_status[slot] = FAIL;
+    fd = rtc_open(0);
+    if (fd != -1 && rtc_write(fd, &rate, sizeof(rate)) == 0) {
+        // Line up with the first virtual interrupt before timing.
+        rtc_read(fd, 0, 0);
+        start_ns = clock_ns();
+        start_irqs = rtc_irqs;
+        for (i = 0; i < rate * RTC_TEST_SECONDS; i++) {
+            rtc_read(fd, 0, 0);
+        }
+        rtc_test_ns[slot] = (uint32_t)(clock_ns() - start_ns);
+        rtc_test_irqs[slot] = rtc_irqs - start_irqs;
+        rtc_test_status[slot] = PASS;
+    }
+    rtc_close(fd);
+    exit_kernel_process();
+}
+
+/* RTC virtualization test
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Runs three background readers of the RTC at once, at 2, 32
+ *               and 1024 Hz, while the test sleeps. Prints the rate each one
+ *               measured against the TSC. Every rate must be within 1% of
+ *               the one asked for, and the hardware RTC must stop once the
+ *               last reader has closed it.
+ * Coverage: rtc_open, rtc_read, rtc_write, rtc_close, handle_RTC
+ * Files: rtc_driver.c, interrupts.c
+ */
+int rtc_virtual_test()
+{
+    TEST_HEADER;
+
+    int pids[RTC_TEST_READERS];
+    uint32_t expected = RTC_TEST_SECONDS * 1000000000U;
+    uint32_t measured;
+    uint32_t error;
+    uint32_t start_irqs;
+    uint32_t start_ms;
+    int result = PASS;
+    int done;
+    int i;
+
+    cli();
+    for (i = 0; i < RTC_TEST_READERS; i++) {
+        pids[i] = create_kernel_process(rtc_test_reader);
+        if (pids[i] == -1) {
+            sti();
+            return FAIL;
+        }
+        rtc_test_slot[pids[i]] = i;
+    }
+    sti();
+
+    do_call(SYS_SLEEP, RTC_TEST_SECONDS + 1, 0, 0);
+    do {
+        done = 1;
+        for (i = 0; i < RTC_TEST_READERS; i++) {
+            if (control_blocks[pids[i]].pid != -1) {
+                done = 0;
+            }
+        }
+    } while (!done);
+
+    for (i = 0; i < RTC_TEST_READERS; i++) {
+        if (rtc_test_status[i] != PASS || rtc_test_ns[i] == 0) {
+            return FAIL;
+        }
+        // Each reader made RTC_TEST_SECONDS worth of reads, so its time
+        // should be RTC_TEST_SECONDS.
+        measured = rtc_test_ns[i];
+        error = (measured > expected) ? measured - expected : expected - measured;
+        error /= expected / 1000;
+        printf("%u Hz reader: %u reads in %u us, %u per mille off, %u hardware interrupts\n",
+            rtc_test_rates[i], rtc_test_rates[i] * RTC_TEST_SECONDS, measured / 1000,
+            error, rtc_test_irqs[i]);
+        if (error >= 10) {
+            result = FAIL;
+        }
+    }
+
+    // Nothing has the RTC open now, so it should be quiet.
+    start_irqs = rtc_irqs;
+    start_ms = clock_ms();
+    while (clock_ms() - start_ms < 100) {}
+    printf("%u RTC interrupts with no readers\n", rtc_irqs - start_irqs);
+    if (rtc_open_count != 0 || rtc_irqs != start_irqs) {
+        result = FAIL;
+    }
+
+    return result;
+}
+
+#define SMP_BENCH_CPUS      4
+#define SMP_BENCH_PROCS     8           // CPU-bound processes in each run.
+#define SMP_BENCH_WORK      (1 << 24)   // Loop iterations of each process.
+
+static volatile uint32_t smp_bench_sink;
+static volatile int smp_bench_left;
+static wait_queue_t smp_bench_done;
+
+/* Benchmark helper - CPU-bound process for the SMP benchmark
+ * Runs SMP_BENCH_WORK xorshift steps without the kernel lock, so processes
+ * on other CPUs run alongside it, then wakes the benchmark if it is the
+ * last one to finish.
+ */
+static void smp_bench_worker()
+{
+    uint32_t x = 2463534242U + current_pid;
+    uint32_t i;
+
+    // The loop touches only registers.
+    unlock_kernel(1);
+    for (i = SMP_BENCH_WORK; i > 0; i--) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    lock_kernel();
+
+    smp_bench_sink ^= x;
+    if (--smp_bench_left == 0) {
+        wait_queue_wake(&smp_bench_done);
+    }
+    exit_kernel_process();
+}
+
+/* Benchmark - SMP scaling
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Runs SMP_BENCH_PROCS CPU-bound kernel processes spread
+ *               over 1 to SMP_BENCH_CPUS CPUs, the boot CPU included, and
+ *               prints the time each run took and its speedup over one
+ *               CPU. While it runs, only the CPUs in use take processes.
+ *               Only counts up to the CPUs scheduling processes are run;
+ *               boot QEMU with -smp 4 and the local APIC timer to see all
+ *               of them.
+ * Coverage: per-CPU run queues, timer_handler, create_kernel_process_on,
+ *           big kernel lock, AP startup
+ * Files: interrupts.c, smp.c, process_control.c, lock.c
+ */
+int bench_smp_scaling()
+{
+    TEST_HEADER;
+
+    int result = PASS;
+    int cpus_used = sched_cpus;
+    uint32_t one_cpu = 0;
+    uint32_t ms;
+    int flags = 0;
+    int n;
+    int i;
+
+    printf("%d of %d CPUs online, %d scheduling processes\n",
+        cpus_online, num_cpus, cpus_used);
+    wait_queue_init(&smp_bench_done);
+    for (n = 1; n <= SMP_BENCH_CPUS && n <= cpus_used && result == PASS; n++) {
+        sched_cpus = n;
+        irq_save(flags);
+        smp_bench_left = SMP_BENCH_PROCS;
+        ms = clock_ms();
+        for (i = 0; i < SMP_BENCH_PROCS; i++) {
+            if (create_kernel_process_on(smp_bench_worker, i % n) == FAILURE) {
+                smp_bench_left -= SMP_BENCH_PROCS - i;
+                result = FAIL;
+                break;
+            }
+        }
+        while (smp_bench_left > 0) {
+            wait_queue_sleep(&smp_bench_done);
+        }
+        irq_restore(flags);
+        ms = clock_ms() - ms;
+        if (ms == 0) {
+            ms = 1;
+        }
+
+        if (result == PASS) {
+            if (n == 1) {
+                one_cpu = ms;
+            }
+            printf("%d CPU(s): %u ms, speedup x%u.%02u\n", n, ms,
+                one_cpu / ms, (one_cpu % ms) * 100 / ms);
+        }
+    }
+    sched_cpus = cpus_used;
+
+    return result;
+}
+
+/* IRQ-off Debug Test
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Opens, reads and closes a file and the RTC, which go
+ *               through the fd table, wait queue and run queue locks, then
+ *               prints the longest interrupts-off interval of each irq_save
+ *               site. Needs IRQOFF_DEBUG defined in lock.h to record them.
+ * Coverage: irq_save, irq_restore, spin_lock_irqsave, irqoff_report
+ * Files: lock.c, lock.h
+ */
+int irqoff_debug_test()
+{
+    TEST_HEADER;
+
+    int32_t fd;
+
+    fd = file_open((const uint8_t *)"frame0.txt");
+    if (fd == FAILURE) {
+        return FAIL;
+    }
+    file_read(fd, bench_buf, BENCH_BUF_SIZE);
+    file_close(fd);
+
+    fd = rtc_open(0);
+    if (fd == FAILURE) {
+        return FAIL;
+    }
+    rtc_read(fd, 0, 0);
+    rtc_close(fd);
+
+#ifdef IRQOFF_DEBUG
+    irqoff_report();
+    return (irqoff_num_sites > 0) ? PASS : FAIL;
+#else
+    printf("IRQOFF_DEBUG is off, nothing recorded\n");
+    return PASS;
+#endif
+}
+
+#define EOI_BENCH_ROUNDS    1000
+#define APIC_TEST_TICKS     10      // Ticks the tick timer must deliver.
+
+/* Benchmark - interrupt controller
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Prints which interrupt controller and tick timer are in
+ *               use and the cycles an RTC end of interrupt takes: two port
+ *               writes on the 8259s, one register write on the local APIC.
+ *               Then waits for APIC_TEST_TICKS ticks and fails if they take
+ *               more than twice as long as they should. Boot with pic=1 to
+ *               compare against the 8259s.
+ * Coverage: apic_irq_init, IOAPIC routing, local APIC timer, send_eoi
+ * Files: apic.c, i8259.c, interrupts.c
+ */
+int bench_interrupt_controller()
+{
+    TEST_HEADER;
+
+    uint32_t start_ticks;
+    uint32_t start_ms;
+    uint32_t elapsed;
+    uint32_t cycles;
+    int flags = 0;
+    int i;
+
+    printf("IRQs: %s, ticks: %s\n", apic_irqs ? "IOAPIC" : "8259",
+        apic_irqs ? "local APIC timer" : "PIT");
+
+    // With nothing in service both controllers ignore the extra EOIs.
+    cli_and_save(flags);
+    cycles = rdtsc();
+    for (i = 0; i < EOI_BENCH_ROUNDS; i++) {
+        send_eoi(IRQ8);
+    }
+    cycles = rdtsc() - cycles;
+    restore_flags(flags);
+    printf("RTC EOI: %u cycles\n", cycles / EOI_BENCH_ROUNDS);
+
+    start_ticks = tick_count;
+    start_ms = clock_ms();
+    while (tick_count - start_ticks < APIC_TEST_TICKS) {
+        if (clock_ms() - start_ms > 2 * APIC_TEST_TICKS * timeslice_ms) {
+            printf("%u of %u ticks arrived\n", tick_count - start_ticks, APIC_TEST_TICKS);
+            return FAIL;
+        }
+    }
+    elapsed = clock_ms() - start_ms;
+    printf("%u ticks in %u ms\n", APIC_TEST_TICKS, elapsed);
+
+    return PASS;
+}
+
+#define RING_TEST_CHUNK     64      // Bytes each linked read and write moves.
+#define RING_TEST_PAIRS     4
+
+static ring_t ring_test_ring;
+static uint8_t ring_test_buf[RING_TEST_PAIRS][RING_TEST_CHUNK];
+
+/* ring_test_queue
+ * Queues one submission on ring_test_ring.
+ */
+static void ring_test_queue(uint16_t op, uint16_t flags, int32_t fd, void * buf, int32_t nbytes)
+{
+    ring_sqe_t * sqe = &ring_test_ring.sqes[ring_test_ring.sq_tail % RING_ENTRIES];
+
+    sqe->op = op;
+    sqe->flags = flags;
+    sqe->fd = fd;
+    sqe->buf = buf;
+    sqe->nbytes = nbytes;
+    sqe->user_data = ring_test_ring.sq_tail;
+    ring_test_ring.sq_tail++;
+}
+
+/* Ring Test
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Checks ring_setup turns down a ring outside program memory,
+ *               then registers a kernel ring for the current process by
+ *               hand and runs an open, RING_TEST_PAIRS reads each linked to
+ *               a write to the terminal, and a close in one ring_enter.
+ *               Checks the completions come back in order with the results
+ *               the system calls would give.
+ * Coverage: ring_setup, ring_enter, RING_LINK
+ * Files: ring.c
+ */
+int ring_test()
+{
+    TEST_HEADER;
+
+    pcb_t * pcb = &control_blocks[current_pid];
+    ring_t * saved = pcb->ring;
+    int32_t fd;
+    int32_t ran;
+    uint32_t i;
+    int result = PASS;
+
+    if (ring_setup(&ring_test_ring) != FAILURE) {
+        return FAIL;
+    }
+
+    // The next fd open hands out is the one the ring's open will get.
+    fd = open((const uint8_t *)"frame0.txt");
+    if (fd == FAILURE) {
+        return FAIL;
+    }
+    close(fd);
+
+    memset(&ring_test_ring, 0, sizeof(ring_test_ring));
+    pcb->ring = &ring_test_ring;
+    ring_test_queue(RING_OP_OPEN, 0, 0, "frame0.txt", 0);
+    for (i = 0; i < RING_TEST_PAIRS; i++) {
+        ring_test_queue(RING_OP_READ, 0, fd, ring_test_buf[i], RING_TEST_CHUNK);
+        ring_test_queue(RING_OP_WRITE, RING_LINK, 1, ring_test_buf[i], 0);
+    }
+    ring_test_queue(RING_OP_CLOSE, 0, fd, NULL, 0);
+
+    ran = ring_enter();
+    printf("\n");
+    pcb->ring = saved;
+
+    if (ran != 2 * RING_TEST_PAIRS + 2 || ring_test_ring.cq_tail != (uint32_t)ran) {
+        return FAIL;
+    }
+    for (i = 0; i < (uint32_t)ran; i++) {
+        if (ring_test_ring.cqes[i].user_data != i) {
+            result = FAIL;
+        }
+    }
+    if (ring_test_ring.cqes[0].result != fd || ring_test_ring.cqes[ran - 1].result != 0) {
+        result = FAIL;
+    }
+    // Each write moved what its read did.
+    for (i = 0; i < RING_TEST_PAIRS; i++) {
+        if (ring_test_ring.cqes[2 * i + 1].result != ring_test_ring.cqes[2 * i + 2].result) {
+            result = FAIL;
+        }
+    }
+    return result;
+}
+
+/* vdso_test_ns
+ * Reads the clock from the kernel data page the way the user library does.
+ */
+static uint64_t vdso_test_ns(const volatile vdso_t * page)
+{
+    uint32_t seq;
+    uint64_t delta;
+    uint64_t ns;
+
+    do {
+        while ((seq = page->seq) & 1) {}
+        delta = rdtsc64() - page->base_tsc;
+        ns = page->base_ns;
+        while (delta >= page->rebase_cycles) {
+            ns += page->rebase_ns;
+            delta -= page->rebase_cycles;
+        }
+        ns += ((uint64_t)(uint32_t)delta * page->clock_mult) >> page->clock_shift;
+    } while (seq != page->seq);
+    return ns;
+}
+
+/* Kernel Data Page Test
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Checks the page is mapped read-only for user code at VDSO,
+ *               that the tick count in it follows tick_count, and that the
+ *               clock read through it is within 10us of clock_ns.
+ * Coverage: vdso_map, vdso_update, clock publishing
+ * Files: vdso.c, clocksource.c, interrupts.c
+ */
+int vdso_test()
+{
+    TEST_HEADER;
+
+    const volatile vdso_t * page = (const volatile vdso_t *)VDSO;
+    uint32_t entry = vidmap_tables[0][VDSO_IDX];
+    uint32_t start_ticks;
+    uint64_t kernel_ns;
+    uint64_t user_ns;
+    uint32_t diff;
+
+    if ((entry & ~(PAGE_4KB - 1)) != (uint32_t)vdso_page ||
+        !(entry & USER_MASK) || (entry & READWRITE_MASK)) {
+        return FAIL;
+    }
+
+    start_ticks = tick_count;
+    while (tick_count == start_ticks) {}
+    if (page->ticks != tick_count) {
+        printf("page has tick %u, kernel %u\n", page->ticks, tick_count);
+        return FAIL;
+    }
+
+    user_ns = vdso_test_ns(page);
+    kernel_ns = clock_ns();
+    diff = (uint32_t)(kernel_ns - user_ns);
+    printf("clock through the page %u ns behind clock_ns\n", diff);
+    return (kernel_ns >= user_ns && diff < 10000) ? PASS : FAIL;
+}
+
+#define SYSSTAT_TEST_CALLS  100
+
+/* System Call Statistics Test
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Makes SYSSTAT_TEST_CALLS failing closes through int $0x80
+ *               and checks they are counted as calls and errors, timed and
+ *               put in the histogram, for the current process and in the
+ *               totals. Checks sysstat turns down a kernel buffer.
+ * Coverage: syscall_dispatch, sysstat
+ * Files: sysstat.c, syscalls_wrapper.S
+ */
+int sysstat_test()
+{
+    TEST_HEADER;
+
+    syscall_stat_t * mine = &control_blocks[current_pid].syscalls[SYS_CLOSE - 1];
+    syscall_stat_t * total = &syscall_totals[SYS_CLOSE - 1];
+    syscall_stat_t before = *mine;
+    uint32_t total_calls = total->calls;
+    uint32_t hist = 0;
+    int i;
+
+    for (i = 0; i < SYSSTAT_TEST_CALLS; i++) {
+        do_call(SYS_CLOSE, -1, 0, 0);
+    }
+
+    for (i = 0; i < SYSCALL_HIST_BUCKETS; i++) {
+        hist += mine->hist[i] - before.hist[i];
+    }
+    printf("close: %u calls, %u cycles each\n", mine->calls - before.calls,
+        (uint32_t)(mine->cycles - before.cycles) / SYSSTAT_TEST_CALLS);
+
+    if (mine->calls - before.calls != SYSSTAT_TEST_CALLS ||
+        mine->errors - before.errors != SYSSTAT_TEST_CALLS ||
+        hist != SYSSTAT_TEST_CALLS || mine->cycles == before.cycles ||
+        total->calls - total_calls != SYSSTAT_TEST_CALLS) {
+        return FAIL;
+    }
+    return (do_call(SYS_SYSSTAT, SYSSTAT_ALL, (int)syscall_totals, 0) == FAILURE) ? PASS : FAIL;
+}
+
+#define JITTER_TEST_TICKS   200     // One-tick sleeps the timing process makes.
+#define JITTER_TEST_CHUNK   4096    // Bytes the busy reader asks for per read.
+
+static volatile int jitter_test_stop;
+static volatile int jitter_test_done;
+static volatile uint32_t jitter_test_reads;
+static uint32_t jitter_test_worst;
+static uint8_t jitter_test_buf[JITTER_TEST_CHUNK];
+
+/* jitter_test_wake
+ * Sleep timer of jitter_test_sleeper. Wakes it.
+ * Inputs: pid - the sleeping process
+ * Outputs: None
+ * Side Effects: Puts the process back on the run queue.
+ */
+static void jitter_test_wake(int pid)
+{
+    wait_queue_wake(&control_blocks[pid].sleep_queue);
+}
+
+/* jitter_test_sleeper
+ * Background process for syscall_preempt_test. Sleeps until each of the
+ * next JITTER_TEST_TICKS tick boundaries in turn and records how far the
+ * time between two wakeups strayed from a tick at worst.
+ * Inputs: None
+ * Outputs: None
+ * Side Effects: Sets jitter_test_worst and jitter_test_done, then exits.
+ */
+static void jitter_test_sleeper()
+{
+    pcb_t * pcb = &control_blocks[current_pid];
+    uint64_t last = 0;
+    uint64_t now;
+    uint32_t target;
+    uint32_t gap;
+    uint32_t off;
+    int i;
+
+    jitter_test_worst = 0;
+    timer_init(&pcb->sleep_timer, jitter_test_wake, current_pid);
+    for (i = 0; i <= JITTER_TEST_TICKS; i++) {
+        cli();
+        target = tick_count + clock_peek_ticks() + 1;
+        while ((int32_t)(target - tick_count) > 0) {
+            timer_add(&pcb->sleep_timer, target);
+            wait_queue_sleep(&pcb->sleep_queue);
+        }
+        sti();
+        now = clock_ns();
+        // The first wakeup only lines up with a tick boundary.
+        if (i != 0) {
+            gap = (uint32_t)(now - last);
+            off = (gap > tick_period_ns) ? gap - tick_period_ns : tick_period_ns - gap;
+            if (off > jitter_test_worst) {
+                jitter_test_worst = off;
+            }
+        }
+        last = now;
+    }
+    timer_cancel(&pcb->sleep_timer);
+    jitter_test_done = 1;
+    exit_kernel_process();
+}
+
+/* jitter_test_reader
+ * Background process for syscall_preempt_test. Reads BENCH_FILE through
+ * int $0x80 back to back, starting over at the end, until told to stop.
+ * Inputs: None
+ * Outputs: None
+ * Side Effects: Counts its reads in jitter_test_reads, then exits.
+ */
+static void jitter_test_reader()
+{
+    int32_t fd = do_call(SYS_OPEN, (int)BENCH_FILE, 0, 0);
+
+    while (!jitter_test_stop && fd != -1) {
+        if (do_call(SYS_READ, fd, (int)jitter_test_buf, JITTER_TEST_CHUNK) <= 0) {
+            do_call(SYS_CLOSE, fd, 0, 0);
+            fd = do_call(SYS_OPEN, (int)BENCH_FILE, 0, 0);
+        }
+        jitter_test_reads++;
+    }
+    do_call(SYS_CLOSE, fd, 0, 0);
+    exit_kernel_process();
+}
+
+/* Reentrant System Call Test
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Runs a process on terminal 2 that sleeps a tick at a time
+ *               and measures its timer jitter, first alone and then while a
+ *               process on terminal 1 hammers read on a large file. Prints
+ *               the worst jitter of both runs and the reads made. Reads run
+ *               with interrupts on and can be preempted, so the reader may
+ *               cost the sleeper at most one more tick.
+ * Coverage: system_call, syscall_dispatch, timer_handler
+ * Files: syscalls_wrapper.S, syscalls.c, interrupts.c
+ */
+int syscall_preempt_test()
+{
+    TEST_HEADER;
+
+    uint32_t worst[2];
+    int sleeper = -1;
+    int reader = -1;
+    int run;
+
+    // The first run has the CPU to itself, the second shares it with the reader.
+    for (run = 0; run < 2; run++) {
+        cli();
+        jitter_test_stop = 0;
+        jitter_test_done = 0;
+        jitter_test_reads = 0;
+        sleeper = create_kernel_process(jitter_test_sleeper);
+        if (sleeper == -1) {
+            sti();
+            return FAIL;
+        }
+        control_blocks[sleeper].terminal = 2;
+        if (run == 1) {
+            reader = create_kernel_process(jitter_test_reader);
+            if (reader == -1) {
+                sti();
+                return FAIL;
+            }
+            control_blocks[reader].terminal = 1;
+        }
+        sti();
+
+        while (!jitter_test_done) {
+            do_call(SYS_SLEEP, 1, 0, 0);
+        }
+        jitter_test_stop = 1;
+        worst[run] = jitter_test_worst;
+    }
+
+    // Wait for both to exit.
+    while (control_blocks[sleeper].pid != -1 || control_blocks[reader].pid != -1) {}
+
+    printf("worst jitter: %u us alone, %u us next to %u reads\n",
+        worst[0] / 1000, worst[1] / 1000, jitter_test_reads);
+
+    if (jitter_test_reads == 0) {
+        return FAIL;
+    }
+    return (worst[1] <= worst[0] + tick_period_ns) ? PASS : FAIL;
+}
+
+#define POLL_TEST_TIMEOUT_MS    100
+
+/* Poll Test
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Opens an rtc file at the default 2 Hz, a text file and a
+ *               directory. Makes the rtc file O_NONBLOCK and checks a read
+ *               fails at once until its interrupt comes. Polls the rtc file,
+ *               the text file and a closed fd without waiting, then the rtc
+ *               file with a timeout, then without one. Prints how long the
+ *               waits took. poll must also turn down a kernel array.
+ * Coverage: fcntl, poll, rtc_poll, rtc_read with O_NONBLOCK
+ * Files: poll.c, syscalls.c, rtc_driver.c, interrupts.c
+ */
+int poll_test()
+{
+    TEST_HEADER;
+
+    pollfd_t fds[3];
+    int32_t rtc_fd;
+    int32_t file_fd;
+    int32_t dir_fd;
+    int32_t ret;
+    uint32_t start_ms;
+    uint32_t timeout_wait;
+    uint32_t rtc_wait;
+    int result = PASS;
+
+    rtc_fd = open((const uint8_t *)"rtc");
+    file_fd = open((const uint8_t *)"frame0.txt");
+    dir_fd = open((const uint8_t *)".");
+    if (rtc_fd == FAILURE || file_fd == FAILURE || dir_fd == FAILURE || dir_fd == FDT_SIZE - 1) {
+        return FAIL;
+    }
+
+    // Directories never block, so they keep no O_NONBLOCK.
+    if (fcntl(rtc_fd, F_SETFL, O_NONBLOCK) != 0 || fcntl(rtc_fd, F_GETFL, 0) != O_NONBLOCK ||
+        fcntl(dir_fd, F_SETFL, O_NONBLOCK) != 0 || fcntl(dir_fd, F_GETFL, 0) != 0 ||
+        fcntl(FDT_SIZE - 1, F_GETFL, 0) != FAILURE) {
+        result = FAIL;
+    }
+    if (rtc_read(rtc_fd, 0, 0) != FAILURE) {
+        result = FAIL;
+    }
+    if (poll(fds, 3, 0) != FAILURE) {
+        result = FAIL;
+    }
+
+    // The rtc is half a second from its first interrupt.
+    fds[0].fd = rtc_fd;
+    fds[1].fd = file_fd;
+    fds[2].fd = FDT_SIZE - 1;
+    fds[0].events = fds[1].events = fds[2].events = POLLIN;
+    ret = poll_fds(fds, 3, 0);
+    if (ret != 2 || fds[0].revents != 0 || fds[1].revents != POLLIN || fds[2].revents != POLLNVAL) {
+        result = FAIL;
+    }
+
+    start_ms = clock_ms();
+    ret = poll_fds(fds, 1, POLL_TEST_TIMEOUT_MS);
+    timeout_wait = clock_ms() - start_ms;
+    if (ret != 0 || timeout_wait < POLL_TEST_TIMEOUT_MS) {
+        result = FAIL;
+    }
+
+    start_ms = clock_ms();
+    ret = poll_fds(fds, 1, -1);
+    rtc_wait = clock_ms() - start_ms;
+    if (ret != 1 || fds[0].revents != POLLIN) {
+        result = FAIL;
+    }
+    // The interrupt is there to take now, and then gone.
+    if (rtc_read(rtc_fd, 0, 0) != 0 || rtc_read(rtc_fd, 0, 0) != FAILURE) {
+        result = FAIL;
+    }
+    printf("timed out after %u ms, rtc ready after %u more ms\n", timeout_wait, rtc_wait);
+
+    close(dir_fd);
+    close(file_fd);
+    close(rtc_fd);
+    return result;
+}
+
+/* Test suite entry point */
+void launch_tests()
+{
+    // Set screen position to top left corner.
+    terminal_clear();
+
+    // launch your tests here
+    // TEST_OUTPUT("idt_test", idt_test());
+    // TEST_OUTPUT("divide by zero test", div_zero_test());
+    // TEST_OUTPUT("deref null test", dref_null_test());
+
+    // TEST_OUTPUT("Test Syscall: Open" , syscall_open_test());
+    // TEST_OUTPUT("Test Syscall: Close", syscall_close_test());
+    // TEST_OUTPUT("Test Syscall: Read File" , syscall_read_file_test());
+    // TEST_OUTPUT("Test Syscall: Read Directory" , syscall_read_directory_test());
+    // TEST_OUTPUT("Test Syscall: Read and Write RTC" , syscall_read_write_rtc_test());
+    // TEST_OUTPUT("Test Syscall: Write", syscall_write_fd_test());
+
+    // TEST_OUTPUT("Test File: Open", file_open_test());
+    // TEST_OUTPUT("Test File: Read Binary", file_read_binary_test());
+    // TEST_OUTPUT("Test File: Read Text", file_read_text_test());
+    // TEST_OUTPUT("Test File: Read Long", file_read_long_test());
+    // TEST_OUTPUT("Test File: Close", file_close_test());
+    // TEST_OUTPUT("Test File: Write", file_write_test());
+
+    // TEST_OUTPUT("Test Dir: Read", dir_read_test());
+    // TEST_OUTPUT("Test Dir: write", dir_write_test());
+    // TEST_OUTPUT("Test Dir: open", dir_open_test());
+    // TEST_OUTPUT("Test Dir: Close", dir_close_test());
+
+    // TEST_OUTPUT("keyboard_open", test_keyboard_open());
+    // TEST_OUTPUT("keyboard_write", test_keyboard_write());
+
+    // TEST_OUTPUT("terminal_open", test_terminal_open());
+    // TEST_OUTPUT("terminal_write", test_terminal_write());
+    // TEST_OUTPUT("terminal_read", test_terminal_read());
+
+    // TEST_OUTPUT("Test RTC: Open", rtc_open_test());
+    // TEST_OUTPUT("Test RTC: Write", rtc_write_test());
+
+    // TEST_OUTPUT("Test File: syscall_open", syscall_terminal_write_test());
+
+    // TEST_OUTPUT("Test File: system_call", syscall_parameter_test());
+
+    // TEST_OUTPUT("Bench: read_data throughput", bench_read_data_throughput());
+    // TEST_OUTPUT("Bench: dentry lookup", bench_dentry_lookup());
+    // TEST_OUTPUT("Bench: exec latency", bench_exec_latency());
+    // TEST_OUTPUT("Frame allocator stress", frame_allocator_stress_test());
+    // TEST_OUTPUT("Bench: context switch", bench_context_switch());
+    // TEST_OUTPUT("Bench: tick cost", bench_tick_cost());
+    // TEST_OUTPUT("Bench: counter next to idle shell", bench_counter_next_to_idle_shell());
+    // TEST_OUTPUT("Bench: idle time", bench_idle_time());
+    // TEST_OUTPUT("Bench: run queue fairness", bench_run_queue_fairness());
+    // TEST_OUTPUT("Bench: keystroke latency", bench_keystroke_latency());
+    // TEST_OUTPUT("Clocksource", clocksource_test());
+    // TEST_OUTPUT("Bench: timer interrupt rate", bench_timer_irq_rate());
+    // TEST_OUTPUT("Timer wheel", timer_wheel_test());
+    // TEST_OUTPUT("Sleep", sleep_test());
+    // TEST_OUTPUT("RTC virtualization", rtc_virtual_test());
+    // TEST_OUTPUT("Bench: SMP scaling", bench_smp_scaling());
+    // TEST_OUTPUT("IRQ-off debug", irqoff_debug_test());
+    // TEST_OUTPUT("Bench: interrupt controller", bench_interrupt_controller());
+    // TEST_OUTPUT("Submission ring", ring_test());
+    // TEST_OUTPUT("Kernel data page", vdso_test());
+    // TEST_OUTPUT("System call statistics", sysstat_test());
+    // TEST_OUTPUT("Reentrant system calls", syscall_preempt_test());
+    // TEST_OUTPUT("Poll", poll_test());
 
      TEST_OUTPUT("Test File: syscall_execute" , syscall_exe_test());
     //cursor_update();
@@ -0,0 +1,259 @@
+/* timer_wheel.c - Hierarchical timing wheel for tick-based timers.
+ * vim:ts=4 noexpandtab
+ */
+#include "timer_wheel.h"
+#include "lib.h"
+#include "lock.h"
+
+// Level 0 has a slot per tick for the next 64 ticks. Each level up has a
+// slot per 64 slots of the level below; its timers move down a level
+// (cascade) when the level below wraps around to that slot.
+static wheel_timer_t * wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+// Next tick the wheel has to process.
+static uint32_t wheel_tick;
+// Protects the wheel and the armed timers' links.
+static spinlock_t timer_lock;
+
+/*
+ * timer_wheel_init(uint32_t now)
+ *   DESCRIPTION: Empties the wheel.
+ *   INPUTS: uint32_t now - current tick.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timer_wheel_init(uint32_t now)
+{
+    int level;
+    int i;
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        for (i = 0; i < WHEEL_SLOTS; i++) {
+            wheel[level][i] = NULL;
+        }
+    }
+    wheel_tick = now;
+    timers_pending = 0;
+}
+
+/*
+ * timer_init(wheel_timer_t * timer, void (*function)(int data), int data)
+ *   DESCRIPTION: Sets up a timer that is not armed.
+ *   INPUTS: wheel_timer_t * timer - the timer.
+ *           void (*function)(int data) - called when the timer fires.
+ *           int data - passed to function.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timer_init(wheel_timer_t * timer, void (*function)(int data), int data)
+{
+    timer->slot = NULL;
+    timer->function = function;
+    timer->data = data;
+}
+
+/*
+ * timer_place(wheel_timer_t * timer)
+ *   DESCRIPTION: Links a timer into the slot for its expiry tick, at the
+ *                lowest level that reaches that far. A timer that is
+ *                already due goes in the slot processed next.
+ *   INPUTS: wheel_timer_t * timer - the timer.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void timer_place(wheel_timer_t * timer)
+{
+    int32_t delta = (int32_t)(timer->expires - wheel_tick);
+    uint32_t expires = timer->expires;
+    int level = 0;
+    wheel_timer_t ** slot;
+
+    if (delta < 0) {
+        expires = wheel_tick;
+    } else {
+        while (level < WHEEL_LEVELS - 1 && delta >= (1 << ((level + 1) * WHEEL_BITS))) {
+            level++;
+        }
+    }
+    slot = &wheel[level][(expires >> (level * WHEEL_BITS)) & WHEEL_MASK];
+
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot != NULL) {
+        (*slot)->prev = timer;
+    }
+    *slot = timer;
+}
+
+/*
+ * timer_unlink(wheel_timer_t * timer)
+ *   DESCRIPTION: Takes a timer out of its slot.
+ *   INPUTS: wheel_timer_t * timer - an armed timer.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void timer_unlink(wheel_timer_t * timer)
+{
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        *timer->slot = timer->next;
+    }
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+    timer->slot = NULL;
+}
+
+/*
+ * timer_add(wheel_timer_t * timer, uint32_t expires)
+ *   DESCRIPTION: Arms a timer, or moves it if it is already armed. Expiry
+ *                ticks more than WHEEL_MAX_TICKS ahead are pulled in to that.
+ *   INPUTS: wheel_timer_t * timer - a timer set up by timer_init.
+ *           uint32_t expires - tick to fire on.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timer_add(wheel_timer_t * timer, uint32_t expires)
+{
+    int flags = 0;
+
+    spin_lock_irqsave(&timer_lock, flags);
+    if (timer->slot != NULL) {
+        timer_unlink(timer);
+    } else {
+        timers_pending++;
+    }
+    if ((int32_t)(expires - wheel_tick) > WHEEL_MAX_TICKS) {
+        expires = wheel_tick + WHEEL_MAX_TICKS;
+    }
+    timer->expires = expires;
+    timer_place(timer);
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/*
+ * timer_cancel(wheel_timer_t * timer)
+ *   DESCRIPTION: Disarms a timer. Does nothing if it is not armed.
+ *   INPUTS: wheel_timer_t * timer - the timer.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timer_cancel(wheel_timer_t * timer)
+{
+    int flags = 0;
+
+    spin_lock_irqsave(&timer_lock, flags);
+    if (timer->slot != NULL) {
+        timer_unlink(timer);
+        timers_pending--;
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/*
+ * timer_cascade(int level)
+ *   DESCRIPTION: Moves the timers in a level's current slot down to the
+ *                levels below.
+ *   INPUTS: int level - the level, 1 or higher.
+ *   OUTPUTS: none
+ *   RETURN VALUE: Index of the slot that was emptied.
+ *   SIDE EFFECTS: none
+ */
+static int timer_cascade(int level)
+{
+    int idx = (wheel_tick >> (level * WHEEL_BITS)) & WHEEL_MASK;
+    wheel_timer_t * timer = wheel[level][idx];
+    wheel_timer_t * next;
+
+    wheel[level][idx] = NULL;
+    while (timer != NULL) {
+        next = timer->next;
+        timer_place(timer);
+        timer = next;
+    }
+    return idx;
+}
+
+/*
+ * timer_wheel_run(uint32_t now)
+ *   DESCRIPTION: Fires every timer due up to and including tick now. Called
+ *                from the timer interrupt, which may have skipped ticks.
+ *   INPUTS: uint32_t now - current tick.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Calls the functions of the timers that fire, with
+ *                 interrupts off. They may add and cancel timers.
+ */
+void timer_wheel_run(uint32_t now)
+{
+    wheel_timer_t * timer;
+    int level;
+    int idx;
+
+    spin_lock(&timer_lock);
+    while ((int32_t)(now - wheel_tick) >= 0) {
+        // Nothing armed: skip straight to now.
+        if (timers_pending == 0) {
+            wheel_tick = now + 1;
+            break;
+        }
+
+        idx = wheel_tick & WHEEL_MASK;
+        if (idx == 0) {
+            level = 1;
+            while (level < WHEEL_LEVELS && timer_cascade(level) == 0) {
+                level++;
+            }
+        }
+
+        while ((timer = wheel[0][idx]) != NULL) {
+            timer_unlink(timer);
+            timers_pending--;
+            spin_unlock(&timer_lock);
+            timer->function(timer->data);
+            spin_lock(&timer_lock);
+        }
+        wheel_tick++;
+    }
+    spin_unlock(&timer_lock);
+}
+
+/*
+ * timer_next_deadline(uint32_t * deadline)
+ *   DESCRIPTION: Finds the next tick the wheel needs to run on: the first
+ *                level 0 slot with a timer in it, or the next cascade if
+ *                that comes first.
+ *   INPUTS: none
+ *   OUTPUTS: uint32_t * deadline - the tick.
+ *   RETURN VALUE: 1 if there is a deadline, 0 if no timer is armed.
+ *   SIDE EFFECTS: Called with interrupts off.
+ */
+int timer_next_deadline(uint32_t * deadline)
+{
+    uint32_t tick;
+    int i;
+
+    spin_lock(&timer_lock);
+    tick = wheel_tick;
+    if (timers_pending == 0) {
+        spin_unlock(&timer_lock);
+        return 0;
+    }
+    for (i = 0; i < WHEEL_SLOTS; i++, tick++) {
+        if (i > 0 && (tick & WHEEL_MASK) == 0) {
+            break;
+        }
+        if (wheel[0][tick & WHEEL_MASK] != NULL) {
+            break;
+        }
+    }
+    spin_unlock(&timer_lock);
+    *deadline = tick;
+    return 1;
+}
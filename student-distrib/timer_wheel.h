@@ -0,0 +1,33 @@
+/* timer_wheel.h - Hierarchical timing wheel for tick-based timers.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#include "types.h"
+
+#define WHEEL_LEVELS    4                       // Levels, each 64 times coarser than the last.
+#define WHEEL_BITS      6                       // Slots per level as a power of two.
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_MAX_TICKS ((1 << (WHEEL_LEVELS * WHEEL_BITS)) - 1) // Furthest ahead a timer can be set.
+
+// Timer Structure. Timers are linked into the wheel through next and prev,
+// so adding and cancelling are O(1).
+typedef struct wheel_timer
+{
+    struct wheel_timer * next;
+    struct wheel_timer * prev;
+    struct wheel_timer ** slot;     // Slot holding the timer, NULL when not armed.
+    uint32_t expires;               // Tick the timer fires on.
+    void (*function)(int data);     // Called from the timer interrupt when it fires.
+    int data;
+} wheel_timer_t;
+
+uint32_t timers_pending;    // Armed timers.
+
+extern void timer_wheel_init(uint32_t now);
+extern void timer_init(wheel_timer_t * timer, void (*function)(int data), int data);
+extern void timer_add(wheel_timer_t * timer, uint32_t expires);
+extern void timer_cancel(wheel_timer_t * timer);
+extern void timer_wheel_run(uint32_t now);
+extern int timer_next_deadline(uint32_t * deadline);
@@ -0,0 +1,49 @@
+/* vdso.c - Read-only kernel data page mapped into every process.
+ * vim:ts=4 noexpandtab
+ */
+#include "vdso.h"
+#include "interrupts.h"
+#include "terminal.h"
+#include "clocksource.h"
+
+/*
+ * vdso_map(uint32_t * table)
+ *   DESCRIPTION: Maps the page read-only for user code into a VIDMAP page
+ *                table, after VIDMAP itself.
+ *   INPUTS: uint32_t * table - one of vidmap_tables.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void vdso_map(uint32_t * table)
+{
+    table[VDSO_IDX] = (uint32_t)vdso_page | USER_MASK | PRESENT_MASK;
+}
+
+/*
+ * vdso_update()
+ *   DESCRIPTION: Publishes the tick count, this CPU's running process and
+ *                terminal, and each process's run ticks. Called by the
+ *                timer interrupt once it has charged the elapsed ticks and
+ *                picked the next process.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts off.
+ */
+void vdso_update()
+{
+    int pid;
+
+    // Reading the clock moves its base up, keeping readers' catch-up short.
+    clock_ns();
+
+    vdso_write_begin();
+    vdso->ticks = tick_count;
+    vdso->cpu_pid[this_cpu() - cpus] = current_pid;
+    vdso->current_terminal = current_terminal;
+    for (pid = 0; pid < TOTAL_PROCESSES; pid++) {
+        vdso->run_ticks[pid] = control_blocks[pid].run_ticks;
+    }
+    vdso_write_end();
+}
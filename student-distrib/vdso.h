@@ -0,0 +1,71 @@
+/* vdso.h - Read-only kernel data page mapped into every process.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#include "types.h"
+#include "process_control.h"
+
+#define VDSO            0x8422000   // User address of the page, after VIDMAP.
+#define VDSO_IDX        34          // Its entry in the VIDMAP page table.
+#define VDSO_PAGE_SIZE  0x1000
+
+// Kernel Data Page Structure. Processes read it without a system call.
+// The kernel makes seq odd while it writes, so a reader that sees seq odd
+// or changed across its reads tries again. The clock is
+// base_ns + ((tsc - base_tsc) * clock_mult >> clock_shift), for deltas
+// below rebase_cycles; each whole rebase_cycles past base_tsc adds
+// rebase_ns. The user library mirrors this layout.
+typedef struct vdso
+{
+    volatile uint32_t seq;
+    uint32_t ticks;                 // tick_count as of the last timer interrupt.
+    uint32_t tick_period_ns;
+    uint32_t tsc_khz;
+    uint32_t clock_mult;
+    uint32_t clock_shift;
+    uint64_t base_tsc;
+    uint64_t base_ns;
+    uint32_t rebase_cycles;
+    uint32_t rebase_ns;
+    int32_t cpu_pid[MAX_CPUS];      // Process each CPU has, so a reader finds
+                                    // itself from its task register.
+    int32_t current_terminal;       // Terminal on the screen.
+    uint32_t run_ticks[TOTAL_PROCESSES];    // Ticks each process has spent running.
+} vdso_t;
+
+// The page itself. Only a whole page is handed out, so nothing else in the
+// kernel shows through.
+uint8_t vdso_page[VDSO_PAGE_SIZE] __attribute__((aligned(VDSO_PAGE_SIZE)));
+#define vdso ((vdso_t *)vdso_page)
+
+/*
+ * vdso_write_begin()
+ *   DESCRIPTION: Marks the page as being written. Pairs with vdso_write_end.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts off.
+ */
+static inline void vdso_write_begin()
+{
+    vdso->seq++;
+    asm volatile ("" : : : "memory");
+}
+
+/*
+ * vdso_write_end()
+ *   DESCRIPTION: Marks the page as consistent again.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts off.
+ */
+static inline void vdso_write_end()
+{
+    asm volatile ("" : : : "memory");
+    vdso->seq++;
+}
+
+extern void vdso_map(uint32_t * table);
+extern void vdso_update();
@@ -0,0 +1,105 @@
+/* wait_queue.c - Queues of processes blocked on an event.
+ * vim:ts=4 noexpandtab
+ */
+#include "wait_queue.h"
+#include "process_control.h"
+#include "interrupts.h"
+#include "lib.h"
+#include "lock.h"
+
+// Protects every wait queue and the PCBs' wait links.
+static spinlock_t wait_lock;
+
+/*
+ * wait_queue_init(wait_queue_t * queue)
+ *   DESCRIPTION: Empties a wait queue.
+ *   INPUTS: wait_queue_t * queue - the queue to initialize.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void wait_queue_init(wait_queue_t * queue)
+{
+    queue->head = WAIT_QUEUE_EMPTY;
+}
+
+/*
+ * wait_queue_sleep(wait_queue_t * queue)
+ *   DESCRIPTION: Blocks the current process on a queue until wait_queue_wake
+ *                is called on it. A blocked process is kept off the run
+ *                queue, so the rest of its time slice goes to other
+ *                processes. Callers check their wait condition with
+ *                interrupts off and call this in a loop, so a wake between
+ *                the check and the sleep is not lost.
+ *   INPUTS: wait_queue_t * queue - the queue to sleep on.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Enables interrupts while blocked, then restores the
+ *                 caller's interrupt flag.
+ */
+void wait_queue_sleep(wait_queue_t * queue)
+{
+    int flags = 0;
+    int held;
+    int pid = current_pid;
+
+    irq_save(flags);
+    spin_lock(&wait_lock);
+    control_blocks[pid].wait_next = queue->head;
+    queue->head = pid;
+    control_blocks[pid].blocked = 1;
+    spin_unlock(&wait_lock);
+#ifdef IRQOFF_DEBUG
+    // Time spent asleep is not time with interrupts off.
+    irqoff_end();
+#endif
+
+    // Hand the CPU over now rather than at the next tick. The scheduler
+    // runs the idle context if nothing else can run. If this context could
+    // not be set aside it comes straight back and halts here instead.
+    schedule_yield();
+
+    // Whoever wakes this process may need the kernel lock on another CPU.
+    held = kernel_locked();
+    unlock_kernel(held);
+    sti();
+    while (control_blocks[pid].blocked) {
+        __asm__ volatile("hlt");
+    }
+    cli();
+    if (held) {
+        lock_kernel();
+    }
+    irq_restore(flags);
+}
+
+/*
+ * wait_queue_wake(wait_queue_t * queue)
+ *   DESCRIPTION: Makes every process sleeping on a queue runnable again and
+ *                puts it back on the run queue.
+ *   INPUTS: wait_queue_t * queue - the queue to wake.
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Empties the queue. Safe to call from interrupt handlers.
+ */
+void wait_queue_wake(wait_queue_t * queue)
+{
+    int flags = 0;
+    int pid;
+
+    irq_save(flags);
+    spin_lock(&wait_lock);
+    pid = queue->head;
+    queue->head = WAIT_QUEUE_EMPTY;
+    spin_unlock(&wait_lock);
+
+    // The sleepers cannot run again until interrupts are back on, so the
+    // detached chain stays intact while it is walked.
+    while (pid != WAIT_QUEUE_EMPTY)
+    {
+        control_blocks[pid].blocked = 0;
+        schedule_wake(pid);
+        pid = control_blocks[pid].wait_next;
+    }
+    irq_restore(flags);
+}
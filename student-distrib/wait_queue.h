@@ -0,0 +1,18 @@
+/* wait_queue.h - Queues of processes blocked on an event.
+ * vim:ts=4 noexpandtab
+ */
+#pragma once
+
+#include "types.h"
+
+#define WAIT_QUEUE_EMPTY    -1  // No process is waiting.
+
+// Wait Queue Structure. Sleepers are linked through their PCBs' wait_next.
+typedef struct wait_queue
+{
+    int head;
+} wait_queue_t;
+
+extern void wait_queue_init(wait_queue_t * queue);
+extern void wait_queue_sleep(wait_queue_t * queue);
+extern void wait_queue_wake(wait_queue_t * queue);
@@ -13,12 +13,21 @@
 #define KERNEL_DS   0x0018
 #define USER_CS     0x0023
 #define USER_DS     0x002B
-#define KERNEL_TSS  0x0030
-#define KERNEL_LDT  0x0038
+#define KERNEL_LDT  0x0030
+#define KERNEL_TSS  0x0038  /* First CPU's TSS, the other CPUs' follow */
 #define CMOS_REG    0x0070
 #define RTC_REG     0x0071
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE    104
+/* Offset of esp0 in the TSS */
+#define TSS_ESP0    4
+/* Processors the kernel keeps track of, each with its own TSS */
+#define MAX_CPUS    8
+
+/* SYSENTER model specific registers */
+#define MSR_SYSENTER_CS     0x174
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
 
 /* Number of vectors in the interrupt descriptor table (IDT) */
 #define NUM_VEC     256
@@ -121,9 +130,7 @@ extern seg_desc_t ldt_desc_ptr;
 extern seg_desc_t gdt_ptr;
 extern uint32_t ldt;
 
-extern uint32_t tss_size;
-extern seg_desc_t tss_desc_ptr;
-extern tss_t tss;
+extern seg_desc_t tss_desc_ptr[MAX_CPUS];
 
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim)                          \
@@ -0,0 +1,144 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 1024
+#define PAIRS   32      /* Linked read and write pairs per ring_enter. */
+
+static struct ece391_ring ring;
+static uint8_t buf[BUFSIZE];
+static uint32_t traps;
+
+/* Reads the low 32 bits of the time stamp counter. */
+static uint32_t rdtsc ()
+{
+    uint32_t val;
+
+    asm volatile ("rdtsc" : "=a"(val) : : "edx");
+    return val;
+}
+
+/* Copies a file to the terminal one read and write at a time, like cat. */
+static int32_t copy_plain (const uint8_t* name)
+{
+    int32_t fd, cnt, total = 0;
+
+    traps++;
+    if (-1 == (fd = ece391_open (name)))
+        return -1;
+    while (1) {
+        traps++;
+        if (0 >= (cnt = ece391_read (fd, buf, BUFSIZE)))
+            break;
+        traps++;
+        if (-1 == ece391_write (1, buf, cnt))
+            return -1;
+        total += cnt;
+    }
+    traps++;
+    ece391_close (fd);
+    return (cnt == -1) ? -1 : total;
+}
+
+/* Queues one ring entry. */
+static void queue (uint16_t op, uint16_t flags, int32_t fd, void* p, int32_t nbytes)
+{
+    struct ece391_ring_sqe* sqe = &ring.sqes[ring.sq_tail % RING_ENTRIES];
+
+    sqe->op = op;
+    sqe->flags = flags;
+    sqe->fd = fd;
+    sqe->buf = p;
+    sqe->nbytes = nbytes;
+    sqe->user_data = 0;
+    ring.sq_tail++;
+}
+
+/*
+ * Copies a file to the terminal through the ring, PAIRS reads each linked
+ * to a write per trap.  The entries run in order, so they can share buf.
+ */
+static int32_t copy_ring (const uint8_t* name)
+{
+    struct ece391_ring_cqe* cqe;
+    int32_t fd, i, total = 0, done = 0;
+
+    traps++;
+    if (-1 == ece391_ring_setup (&ring))
+        return -1;
+    traps++;
+    if (-1 == (fd = ece391_open (name)))
+        return -1;
+    while (!done) {
+        for (i = 0; i < PAIRS; i++) {
+            queue (RING_OP_READ, 0, fd, buf, BUFSIZE);
+            queue (RING_OP_WRITE, RING_LINK, 1, buf, 0);
+        }
+        traps++;
+        if (-1 == ece391_ring_enter ())
+            return -1;
+        while (ring.cq_head != ring.cq_tail) {
+            cqe = &ring.cqes[ring.cq_head % RING_ENTRIES];
+            /* Reads land on even slots, writes on odd ones. */
+            if (cqe->result <= 0)
+                done = 1;
+            else if (ring.cq_head & 1)
+                total += cqe->result;
+            ring.cq_head++;
+        }
+    }
+    traps++;
+    ece391_close (fd);
+    return total;
+}
+
+static void report (const char* name, int32_t bytes, uint32_t ntraps, uint32_t cycles)
+{
+    uint8_t num[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_itoa (bytes, num, 10);
+    ece391_fdputs (1, num);
+    ece391_fdputs (1, (uint8_t*)" bytes, ");
+    ece391_itoa (ntraps, num, 10);
+    ece391_fdputs (1, num);
+    ece391_fdputs (1, (uint8_t*)" traps, ");
+    ece391_itoa (cycles, num, 10);
+    ece391_fdputs (1, num);
+    ece391_fdputs (1, (uint8_t*)" cycles\n");
+}
+
+int main ()
+{
+    uint8_t name[BUFSIZE];
+    uint32_t plain_cycles, ring_cycles, plain_traps, ring_traps;
+    int32_t plain_bytes, ring_bytes;
+
+    if (0 != ece391_getargs (name, BUFSIZE)) {
+        ece391_fdputs (1, (uint8_t*)"usage: ringcat <file>\n");
+        return 3;
+    }
+
+    traps = 0;
+    plain_cycles = rdtsc ();
+    plain_bytes = copy_plain (name);
+    plain_cycles = rdtsc () - plain_cycles;
+    plain_traps = traps;
+
+    traps = 0;
+    ring_cycles = rdtsc ();
+    ring_bytes = copy_ring (name);
+    ring_cycles = rdtsc () - ring_cycles;
+    ring_traps = traps;
+
+    if (-1 == plain_bytes || -1 == ring_bytes) {
+        ece391_fdputs (1, (uint8_t*)"copy failed\n");
+        return 2;
+    }
+    ece391_fdputs (1, (uint8_t*)"\n");
+    report ("plain: ", plain_bytes, plain_traps, plain_cycles);
+    report ("ring:  ", ring_bytes, ring_traps, ring_cycles);
+
+    return 0;
+}
@@ -102,3 +102,54 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+#define VDSO ((const volatile struct ece391_vdso*)ECE391_VDSO)
+
+static uint64_t rdtsc64(void)
+{
+    uint64_t val;
+
+    asm volatile ("rdtsc" : "=A"(val));
+    return val;
+}
+
+uint64_t ece391_clock_ns(void)
+{
+    uint32_t seq;
+    uint64_t delta, ns;
+
+    do {
+        while ((seq = VDSO->seq) & 1);
+        delta = rdtsc64() - VDSO->base_tsc;
+        ns = VDSO->base_ns;
+        while (delta >= VDSO->rebase_cycles) {
+            ns += VDSO->rebase_ns;
+            delta -= VDSO->rebase_cycles;
+        }
+        ns += ((uint64_t)(uint32_t)delta * VDSO->clock_mult) >> VDSO->clock_shift;
+    } while (seq != VDSO->seq);
+    return ns;
+}
+
+uint32_t ece391_ticks(void)
+{
+    return VDSO->ticks;
+}
+
+uint32_t ece391_cpu_ticks(void)
+{
+    uint32_t seq, ticks;
+    uint16_t tss;
+
+    do {
+        while ((seq = VDSO->seq) & 1);
+        /* The task register tells which CPU this is running on. */
+        asm volatile ("str %0" : "=r"(tss));
+        ticks = VDSO->run_ticks[VDSO->cpu_pid[(tss - ECE391_TSS) >> 3]];
+    } while (seq != VDSO->seq);
+    return ticks;
+}
+
+int32_t ece391_current_terminal(void)
+{
+    return VDSO->current_terminal;
+}
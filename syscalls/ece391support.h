@@ -9,5 +9,40 @@ extern int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n);
 extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
 
+/*
+ * Kernel data page, mapped read-only into every program after the vidmap
+ * page.  The kernel keeps seq odd while it writes; the helpers below read
+ * it without a system call.
+ */
+#define ECE391_VDSO     0x8422000
+#define ECE391_PROCS    33
+#define ECE391_CPUS     8
+#define ECE391_TSS      0x0038  /* TSS selector of the first CPU. */
+
+struct ece391_vdso {
+	uint32_t seq;
+	uint32_t ticks;
+	uint32_t tick_period_ns;
+	uint32_t tsc_khz;
+	uint32_t clock_mult;
+	uint32_t clock_shift;
+	uint64_t base_tsc;
+	uint64_t base_ns;
+	uint32_t rebase_cycles;
+	uint32_t rebase_ns;
+	int32_t cpu_pid[ECE391_CPUS];
+	int32_t current_terminal;
+	uint32_t run_ticks[ECE391_PROCS];
+};
+
+/* Nanoseconds since boot. */
+extern uint64_t ece391_clock_ns(void);
+/* Timer ticks since boot, as of the last timer interrupt. */
+extern uint32_t ece391_ticks(void);
+/* Timer ticks the calling program has spent running. */
+extern uint32_t ece391_cpu_ticks(void);
+/* The terminal on the screen. */
+extern int32_t ece391_current_terminal(void);
+
 #endif /* ECE391SUPPORT_H */
 
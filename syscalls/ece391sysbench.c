@@ -0,0 +1,58 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 32
+#define CALLS   100000
+
+/* Reads the low 32 bits of the time stamp counter. */
+static uint32_t rdtsc ()
+{
+    uint32_t val;
+
+    asm volatile ("rdtsc" : "=a"(val) : : "edx");
+    return val;
+}
+
+/*
+ * Times CALLS null system calls through one entry stub.  Closing fd -1
+ * fails straight away in the kernel, so this is the cost of the trap and
+ * the return.
+ */
+static uint32_t cycles_per_call (void (*entry)(void))
+{
+    uint32_t i, start;
+
+    ece391_entry = entry;
+    start = rdtsc();
+    for (i = 0; i < CALLS; i++) {
+        ece391_close(-1);
+    }
+    return (rdtsc() - start) / CALLS;
+}
+
+static void print_cycles (const char* name, uint32_t cycles)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs(1, (uint8_t*)name);
+    ece391_itoa(cycles, buf, 10);
+    ece391_fdputs(1, buf);
+    ece391_fdputs(1, (uint8_t*)" cycles per call\n");
+}
+
+int main ()
+{
+    void (*fast)(void) = ece391_entry;
+
+    print_cycles("int $0x80: ", cycles_per_call(ece391_int80));
+    if (fast == ece391_sysenter) {
+        print_cycles("sysenter:  ", cycles_per_call(ece391_sysenter));
+    } else {
+        ece391_fdputs(1, (uint8_t*)"sysenter:  not supported by this CPU\n");
+    }
+    ece391_entry = fast;
+
+    return 0;
+}
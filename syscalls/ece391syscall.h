@@ -22,6 +22,114 @@ extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
 
+/*
+ * Maps the contents of an open file read-only into the caller's address
+ * space and stores the address of the first byte in *start.  Returns the
+ * length of the file.  Mappings last until the program halts.
+ */
+extern int32_t ece391_mmap (int32_t fd, uint8_t** start);
+
+/*
+ * Blocks the caller for at least the given time, rounded up to whole timer
+ * ticks.  tv_nsec must be below 1000000000.  Other programs run meanwhile.
+ */
+struct ece391_timespec {
+	uint32_t tv_sec;
+	uint32_t tv_nsec;
+};
+extern int32_t ece391_sleep (uint32_t seconds);
+extern int32_t ece391_nanosleep (const struct ece391_timespec* req);
+
+/*
+ * Batched system calls.  ece391_ring_setup registers a ring in the
+ * program's memory, which fits in a 4kB page, and empties it.  Queue
+ * entries in sqes and move sq_tail up, then ece391_ring_enter runs them in
+ * order with one trap and returns how many it ran.  Each posts its result
+ * to cqes, moving cq_tail up; move cq_head up once they are read.
+ * Indices run freely and are taken modulo RING_ENTRIES.  An entry with
+ * RING_LINK takes nbytes from the result of the one before it, and is
+ * skipped with that result if it was 0 or -1, so a read can feed a write.
+ */
+#define RING_ENTRIES    128
+#define RING_OP_READ    0
+#define RING_OP_WRITE   1
+#define RING_OP_OPEN    2	/* buf is the file name */
+#define RING_OP_CLOSE   3
+#define RING_LINK       0x1
+
+struct ece391_ring_sqe {
+	uint16_t op;
+	uint16_t flags;
+	int32_t fd;
+	void* buf;
+	int32_t nbytes;
+	uint32_t user_data;
+};
+struct ece391_ring_cqe {
+	uint32_t user_data;
+	int32_t result;
+};
+struct ece391_ring {
+	volatile uint32_t sq_head;
+	volatile uint32_t sq_tail;
+	volatile uint32_t cq_head;
+	volatile uint32_t cq_tail;
+	struct ece391_ring_sqe sqes[RING_ENTRIES];
+	struct ece391_ring_cqe cqes[RING_ENTRIES];
+};
+extern int32_t ece391_ring_setup (struct ece391_ring* ring);
+extern int32_t ece391_ring_enter (void);
+
+/*
+ * System call statistics.  ece391_sysstat copies one entry per system
+ * call, in number order, for a running process or, with pid -1, for every
+ * process since boot.  Bucket k > 0 of hist counts calls that took
+ * [2^(SYSSTAT_HIST_SHIFT + k - 1), 2^(SYSSTAT_HIST_SHIFT + k)) cycles; the
+ * last one also everything longer.  Returns the number of entries.
+ */
+#define SYSSTAT_ALL          -1
+#define SYSSTAT_HIST_BUCKETS 16
+#define SYSSTAT_HIST_SHIFT   7
+
+struct ece391_syscall_stat {
+	uint32_t calls;
+	uint32_t errors;
+	uint64_t cycles;
+	uint32_t hist[SYSSTAT_HIST_BUCKETS];
+};
+extern int32_t ece391_sysstat (int32_t pid, struct ece391_syscall_stat* buf);
+
+/*
+ * Non-blocking reads.  ece391_fcntl with F_SETFL and O_NONBLOCK makes reads
+ * of the keyboard or an rtc file fail at once instead of waiting; F_GETFL
+ * reads the flag back.  ece391_poll waits until one of up to 8 files is
+ * ready for the events asked for, or timeout_ms runs out (0 only checks,
+ * -1 waits forever).  It returns the number of entries with revents set.
+ */
+#define O_NONBLOCK 0x800
+#define F_GETFL    3
+#define F_SETFL    4
+#define POLLIN     0x001
+#define POLLOUT    0x004
+#define POLLNVAL   0x020
+
+struct ece391_pollfd {
+	int32_t fd;
+	int16_t events;
+	int16_t revents;
+};
+extern int32_t ece391_fcntl (int32_t fd, int32_t cmd, int32_t arg);
+extern int32_t ece391_poll (struct ece391_pollfd* fds, int32_t nfds, int32_t timeout_ms);
+
+/*
+ * Stubs the calls above trap through: ece391_entry holds SYSENTER's when
+ * the CPU has it and INT $0x80's otherwise.  Programs may point
+ * ece391_entry at either one, e.g. to compare them.
+ */
+extern void ece391_int80 (void);
+extern void ece391_sysenter (void);
+extern void (*ece391_entry) (void);
+
 enum signums {
 	DIV_ZERO = 0,
 	SEGFAULT,
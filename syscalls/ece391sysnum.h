@@ -11,5 +11,14 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_MMAP    11
+#define SYS_SLEEP   12
+#define SYS_NANOSLEEP  13
+#define SYS_RING_SETUP 14
+#define SYS_RING_ENTER 15
+#define SYS_SYSSTAT    16
+#define SYS_FCNTL      17
+#define SYS_POLL       18
+#define NUM_SYSCALLS   SYS_POLL  /* the last call; keep it so when adding one */
 
 #endif /* ECE391SYSNUM_H */
@@ -0,0 +1,98 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+#include "ece391sysnum.h"
+
+#define BUFSIZE 128
+
+static const char* names[] = {
+    "halt", "execute", "read", "write", "open", "close", "getargs",
+    "vidmap", "set_handler", "sigreturn", "mmap", "sleep", "nanosleep",
+    "ring_setup", "ring_enter", "sysstat", "fcntl", "poll"
+};
+
+/* Fails to compile if a call is added without a name here. */
+typedef char names_match_syscalls[(sizeof (names) / sizeof (names[0]) == NUM_SYSCALLS) ? 1 : -1];
+
+static struct ece391_syscall_stat stats[NUM_SYSCALLS];
+
+/* Prints a number right-aligned in a field of the given width. */
+static void put_num (uint32_t value, uint32_t width)
+{
+    uint8_t buf[BUFSIZE];
+    uint32_t len;
+
+    ece391_itoa (value, buf, 10);
+    for (len = ece391_strlen (buf); len < width; len++)
+        ece391_fdputs (1, (uint8_t*)" ");
+    ece391_fdputs (1, buf);
+}
+
+/* Prints a string left-aligned in a field of the given width. */
+static void put_str (const char* s, uint32_t width)
+{
+    uint32_t len;
+
+    ece391_fdputs (1, (uint8_t*)s);
+    for (len = ece391_strlen ((uint8_t*)s); len < width; len++)
+        ece391_fdputs (1, (uint8_t*)" ");
+}
+
+/*
+ * Average cycles per call.  There is no 64-bit division here, so both
+ * numbers are halved until the total fits in 32 bits.
+ */
+static uint32_t average (uint64_t cycles, uint32_t calls)
+{
+    while ((cycles >> 32) != 0) {
+        cycles >>= 1;
+        calls >>= 1;
+    }
+    return (calls == 0) ? 0 : (uint32_t)cycles / calls;
+}
+
+int main ()
+{
+    uint8_t buf[BUFSIZE];
+    int32_t pid = SYSSTAT_ALL;
+    uint32_t i, k;
+
+    /* An argument picks one process; none gives the totals since boot. */
+    if (0 == ece391_getargs (buf, BUFSIZE) && buf[0] != '\0') {
+        pid = 0;
+        for (i = 0; buf[i] >= '0' && buf[i] <= '9'; i++)
+            pid = pid * 10 + (buf[i] - '0');
+    }
+    if (-1 == ece391_sysstat (pid, stats)) {
+        ece391_fdputs (1, (uint8_t*)"no such process\n");
+        return 2;
+    }
+
+    put_str ("call", 12);
+    ece391_fdputs (1, (uint8_t*)"     calls    errors  avg cycles\n");
+    for (i = 0; i < NUM_SYSCALLS; i++) {
+        if (stats[i].calls == 0)
+            continue;
+        put_str (names[i], 12);
+        put_num (stats[i].calls, 10);
+        put_num (stats[i].errors, 10);
+        put_num (average (stats[i].cycles, stats[i].calls), 12);
+        ece391_fdputs (1, (uint8_t*)"\n   ");
+
+        /* The histogram, as log2 of the cycles each call took. */
+        for (k = 0; k < SYSSTAT_HIST_BUCKETS; k++) {
+            if (stats[i].hist[k] == 0)
+                continue;
+            ece391_fdputs (1, (uint8_t*)((k == 0) ? " <2^" : " 2^"));
+            ece391_itoa ((k == 0) ? SYSSTAT_HIST_SHIFT : SYSSTAT_HIST_SHIFT + k - 1, buf, 10);
+            ece391_fdputs (1, buf);
+            ece391_fdputs (1, (uint8_t*)((k == SYSSTAT_HIST_BUCKETS - 1) ? "+:" : ":"));
+            ece391_itoa (stats[i].hist[k], buf, 10);
+            ece391_fdputs (1, buf);
+        }
+        ece391_fdputs (1, (uint8_t*)"\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 128
+#define RATE    2       /* RTC interrupts per second */
+#define SECONDS 30      /* Runs this long unless "q" is typed first */
+
+/*
+ * A game loop in miniature: counts seconds off the RTC and echoes each line
+ * typed, waiting on both at once with ece391_poll instead of blocking in
+ * either read.
+ */
+int main ()
+{
+    uint8_t buf[BUFSIZE];
+    struct ece391_pollfd fds[2];
+    int32_t rate = RATE;
+    int32_t rtc_fd, cnt;
+    uint32_t ticks = 0;
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc")) ||
+        -1 == ece391_write (rtc_fd, &rate, sizeof (rate))) {
+        ece391_fdputs (1, (uint8_t*)"could not open the rtc\n");
+        return 2;
+    }
+    /* A poll that wakes for the rtc must not leave the read blocked. */
+    ece391_fcntl (0, F_SETFL, O_NONBLOCK);
+    ece391_fcntl (rtc_fd, F_SETFL, O_NONBLOCK);
+
+    fds[0].fd = 0;
+    fds[0].events = POLLIN;
+    fds[1].fd = rtc_fd;
+    fds[1].events = POLLIN;
+
+    ece391_fdputs (1, (uint8_t*)"type a line, or q to quit\n");
+    while (ticks < SECONDS * RATE) {
+        if (-1 == ece391_poll (fds, 2, -1)) {
+            ece391_fdputs (1, (uint8_t*)"poll failed\n");
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            if (0 == ece391_read (rtc_fd, buf, 0) && ++ticks % RATE == 0) {
+                ece391_fdputs (1, (uint8_t*)"second ");
+                ece391_itoa (ticks / RATE, buf, 10);
+                ece391_fdputs (1, buf);
+                ece391_fdputs (1, (uint8_t*)"\n");
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            if (-1 == (cnt = ece391_read (0, buf, BUFSIZE - 1)))
+                continue;
+            buf[cnt] = '\0';
+            if (0 == ece391_strcmp (buf, (uint8_t*)"q\n"))
+                break;
+            ece391_fdputs (1, (uint8_t*)"read: ");
+            ece391_fdputs (1, buf);
+        }
+    }
+
+    ece391_close (rtc_fd);
+    return 0;
+}